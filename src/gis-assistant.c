@@ -28,6 +28,7 @@
 #include <glib/gi18n.h>
 
 #include "gis-assistant.h"
+#include "gis-image.h"
 #include "pages/language/gis-language-page.h"
 #include "pages/eulas/gis-eulas-page.h"
 #include "pages/account/gis-account-page.h"
@@ -47,12 +48,49 @@ struct _GisAssistantPrivate {
 	GtkWidget *title;
 	GtkWidget *logo_image;
 
-	GList *pages;
+	GArray *pages;          /* PageEntry, in the order they are shown */
+	gint first_page;        /* index of the first page to show, or -1 */
+	gint current_index;
 	GisPage *current_page;
 
 	GisPageManager *manager;
+
+	guint relabel_id;
+	guint update_tick_id;
+	guint pending_updates;  /* UpdateFlags */
+
+	gchar *preseed_file;
+	gboolean unattended;
+};
+
+enum
+{
+	PROP_0,
+	PROP_PRESEED_FILE,
+	PROP_UNATTENDED,
+	PROP_LAST,
 };
 
+static GParamSpec *obj_props[PROP_LAST];
+
+/* Whether a page is shown only changes with the preseed and the
+ * network availability, so it is worked out when those change and the
+ * neighbours to go to are kept along with it. */
+typedef struct {
+	GisPage  *page;
+	gboolean  visible;
+	gint      prev;         /* previous page to show, or -1 */
+	gint      next;         /* next page to show, or -1 */
+} PageEntry;
+
+#define PAGE_ENTRY(priv,i) (&g_array_index ((priv)->pages, PageEntry, (i)))
+
+typedef enum {
+	UPDATE_TITLEBAR = 1 << 0,
+	UPDATE_BUTTONS  = 1 << 1,
+	UPDATE_FOCUS    = 1 << 2    /* after the buttons, which it depends on */
+} UpdateFlags;
+
 typedef GisPage *(*PreparePage) (GisPageManager *manager);
 
 typedef struct {
@@ -84,56 +122,87 @@ switch_to (GisAssistant *assistant, GisPage *page)
 	gtk_stack_set_visible_child (GTK_STACK (assistant->priv->stack), GTK_WIDGET (page));
 }
 
+static void
+update_page_visibility (GisAssistant *assistant)
+{
+	guint i;
+	gint last;
+	GisAssistantPrivate *priv = assistant->priv;
+
+	for (i = 0; i < priv->pages->len; i++) {
+		PageEntry *entry = PAGE_ENTRY (priv, i);
+		entry->visible = gis_page_should_show (entry->page);
+	}
+
+	last = -1;
+	for (i = 0; i < priv->pages->len; i++) {
+		PageEntry *entry = PAGE_ENTRY (priv, i);
+		entry->prev = last;
+		if (entry->visible)
+			last = i;
+	}
+
+	priv->first_page = -1;
+	for (i = priv->pages->len; i > 0; i--) {
+		PageEntry *entry = PAGE_ENTRY (priv, i - 1);
+		entry->next = priv->first_page;
+		if (entry->visible)
+			priv->first_page = i - 1;
+	}
+}
+
+static gint
+find_page_index (GisAssistant *assistant,
+                 GisPage      *page)
+{
+	guint i;
+	GisAssistantPrivate *priv = assistant->priv;
+
+	for (i = 0; i < priv->pages->len; i++) {
+		if (PAGE_ENTRY (priv, i)->page == page)
+			return i;
+	}
+
+	return -1;
+}
+
 static GisPage *
 find_first_page (GisAssistant *assistant)
 {
-	GList *l = NULL;
 	GisAssistantPrivate *priv = assistant->priv;
 
-	l = g_list_first (priv->pages);
-	if (l) {
-		GisPage *page = GIS_PAGE (l->data);
-		if (gis_page_should_show (page))
-			return page;
-	}
+	if (priv->first_page < 0)
+		return NULL;
 
-	return NULL;
+	return PAGE_ENTRY (priv, priv->first_page)->page;
 }
 
 static GisPage *
 find_next_page (GisAssistant *assistant)
 {
-	GList *l = NULL;
+	gint next;
 	GisAssistantPrivate *priv = assistant->priv;
 
-	l = g_list_find (priv->pages, priv->current_page);
-	if (l) l = l->next;
+	if (priv->current_index < 0)
+		return NULL;
 
-	for (; l != NULL; l = l->next) {
-		GisPage *page = GIS_PAGE (l->data);
-		if (gis_page_should_show (page))
-			return page;
-	}
+	next = PAGE_ENTRY (priv, priv->current_index)->next;
 
-	return NULL;
+	return (next >= 0) ? PAGE_ENTRY (priv, next)->page : NULL;
 }
 
 static GisPage *
 find_prev_page (GisAssistant *assistant)
 {
-	GList *l = NULL;
+	gint prev;
 	GisAssistantPrivate *priv = assistant->priv;
 
-	l = g_list_find (priv->pages, priv->current_page);
-	if (l) l = l->prev;
+	if (priv->current_index < 0)
+		return NULL;
 
-	for (; l != NULL; l = l->prev) {
-		GisPage *page = GIS_PAGE (l->data);
-		if (gis_page_should_show (page))
-			return page;
-	}
+	prev = PAGE_ENTRY (priv, priv->current_index)->prev;
 
-	return NULL;
+	return (prev >= 0) ? PAGE_ENTRY (priv, prev)->page : NULL;
 }
 
 static void
@@ -199,6 +268,49 @@ update_navigation_buttons (GisAssistant *assistant)
 	}
 }
 
+static gboolean
+update_tick_cb (GtkWidget     *widget,
+                GdkFrameClock *frame_clock,
+                gpointer       user_data)
+{
+	guint flags;
+	GisAssistant *assistant = GIS_ASSISTANT (widget);
+	GisAssistantPrivate *priv = assistant->priv;
+
+	flags = priv->pending_updates;
+	priv->pending_updates = 0;
+	priv->update_tick_id = 0;
+
+	if (flags & UPDATE_TITLEBAR)
+		update_titlebar (assistant);
+
+	if (flags & UPDATE_BUTTONS)
+		update_navigation_buttons (assistant);
+
+	if (flags & UPDATE_FOCUS)
+		gtk_widget_grab_focus (priv->forward);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* However often the pages change, the titlebar and the buttons are
+ * updated once per frame, right before it is drawn */
+static void
+queue_update (GisAssistant *assistant,
+              UpdateFlags   flags)
+{
+	GisAssistantPrivate *priv = assistant->priv;
+
+	priv->pending_updates |= flags;
+
+	if (priv->update_tick_id > 0)
+		return;
+
+	priv->update_tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (assistant),
+                                                         update_tick_cb,
+                                                         NULL, NULL);
+}
+
 static void
 update_current_page (GisAssistant *assistant,
                      GisPage      *page)
@@ -209,13 +321,16 @@ update_current_page (GisAssistant *assistant,
 		return;
 
 	priv->current_page = page;
+	priv->current_index = find_page_index (assistant, page);
 
-	update_titlebar (assistant);
-	update_navigation_buttons (assistant);
-	gtk_widget_grab_focus (priv->forward);
+	queue_update (assistant, UPDATE_TITLEBAR | UPDATE_BUTTONS | UPDATE_FOCUS);
 
-	if (page)
+	if (page) {
+		/* a page that has not been relabeled since the last locale
+		 * change yet gets done before it is shown */
+		gis_page_flush_locale_changed (page);
 		gis_page_shown (page);
+	}
 }
 
 static void
@@ -249,20 +364,33 @@ done_button_clicked_cb (GtkWidget *button,
 }
 
 static void
-page_notify_cb (GisPage      *page,
-                GParamSpec       *pspec,
-                GisAssistant *assistant)
+page_title_changed_cb (GisPage      *page,
+                       GParamSpec   *pspec,
+                       GisAssistant *assistant)
 {
-	GisAssistantPrivate *priv = assistant->priv;
+	if (page == assistant->priv->current_page)
+		queue_update (assistant, UPDATE_TITLEBAR);
+}
 
-	if (page != priv->current_page)
-		return;
+/* complete and skippable */
+static void
+page_navigation_changed_cb (GisPage      *page,
+                            GParamSpec   *pspec,
+                            GisAssistant *assistant)
+{
+	if (page == assistant->priv->current_page)
+		queue_update (assistant, UPDATE_BUTTONS);
+}
 
-	if (strcmp (pspec->name, "title") == 0) {
-		update_titlebar (assistant);
-	} else {
-		update_navigation_buttons (assistant);
-	}
+static void
+network_available_changed_cb (GObject    *gobject,
+                              GParamSpec *pspec,
+                              gpointer    user_data)
+{
+	GisAssistant *assistant = GIS_ASSISTANT (user_data);
+
+	update_page_visibility (assistant);
+	queue_update (assistant, UPDATE_BUTTONS);
 }
 
 static void
@@ -279,8 +407,14 @@ current_page_changed_cb (GObject    *gobject,
 static gboolean
 change_current_page_idle (gpointer user_data)
 {
+	GisPage *first_page;
 	GisAssistant *assistant = GIS_ASSISTANT (user_data);
 
+	/* skip the leading pages whose data has been preseeded */
+	first_page = find_first_page (assistant);
+	if (first_page)
+		gtk_stack_set_visible_child (GTK_STACK (assistant->priv->stack), GTK_WIDGET (first_page));
+
 	current_page_changed_cb (G_OBJECT (assistant->priv->stack), NULL, assistant);
 
 	return FALSE;
@@ -303,14 +437,7 @@ locale_changed_cb (GisPageManager *manager,
 static void
 gis_assistant_ui_setup (GisAssistant *assistant)
 {
-	GdkPixbuf *pixbuf = NULL;
-
-	pixbuf = gdk_pixbuf_new_from_resource_at_scale ("/kr/gooroom/initial-setup/logo",
-                                                    120, 60, FALSE, NULL);
-	if (pixbuf) {
-		gtk_image_set_from_pixbuf (GTK_IMAGE (assistant->priv->logo_image), pixbuf);
-		g_object_unref (pixbuf);
-	}
+	gis_image_set_from_name (GTK_IMAGE (assistant->priv->logo_image), "logo", 120, 60);
 
 	gtk_widget_hide (assistant->priv->done);
 }
@@ -321,33 +448,87 @@ gis_assistant_finalize (GObject *object)
 	GisAssistant *assistant = GIS_ASSISTANT (object);
 	GisAssistantPrivate *priv = assistant->priv;
 
+	if (priv->relabel_id > 0) {
+		g_source_remove (priv->relabel_id);
+		priv->relabel_id = 0;
+	}
+
 	g_clear_object (&priv->manager);
+	g_free (priv->preseed_file);
 
-	if (priv->pages) {
-		g_list_free (priv->pages);
-		priv->pages = NULL;
-	}
+	g_array_free (priv->pages, TRUE);
 
 	G_OBJECT_CLASS (gis_assistant_parent_class)->finalize (object);
 }
 
 static void
-gis_assistant_init (GisAssistant *assistant)
+gis_assistant_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
 {
-	PageData *page_data;
-	GisAssistantPrivate *priv;
+	GisAssistant *assistant = GIS_ASSISTANT (object);
+	GisAssistantPrivate *priv = assistant->priv;
 
-	priv = assistant->priv = gis_assistant_get_instance_private (assistant);
+	switch (prop_id)
+	{
+		case PROP_PRESEED_FILE:
+			g_value_set_string (value, priv->preseed_file);
+		break;
+		case PROP_UNATTENDED:
+			g_value_set_boolean (value, priv->unattended);
+		break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
 
-	gtk_widget_init_template (GTK_WIDGET (assistant));
+static void
+gis_assistant_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+	GisAssistant *assistant = GIS_ASSISTANT (object);
+	GisAssistantPrivate *priv = assistant->priv;
 
-	gis_assistant_ui_setup (assistant);
+	switch (prop_id)
+	{
+		case PROP_PRESEED_FILE:
+			g_free (priv->preseed_file);
+			priv->preseed_file = g_value_dup_string (value);
+		break;
+		case PROP_UNATTENDED:
+			priv->unattended = g_value_get_boolean (value);
+		break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+		break;
+	}
+}
 
-	if (gdk_screen_width() < 1028)
-		gtk_widget_set_size_request (GTK_WIDGET (priv->right), 500, 500);
+static void
+gis_assistant_constructed (GObject *object)
+{
+	PageData *page_data;
+	GisAssistant *assistant = GIS_ASSISTANT (object);
+	GisAssistantPrivate *priv = assistant->priv;
 
-	priv->manager = gis_page_manager_new ();
+	G_OBJECT_CLASS (gis_assistant_parent_class)->constructed (object);
 
+	/* the preseed has to be in place before the pages are prepared,
+	 * since they consult it while being constructed */
+	if (priv->preseed_file) {
+		GError *error = NULL;
+
+		if (!gis_page_manager_load_preseed (priv->manager, priv->preseed_file, &error)) {
+			g_warning ("Failed to load preseed file '%s': %s", priv->preseed_file, error->message);
+			g_error_free (error);
+		}
+	}
+
+	gis_page_manager_set_unattended (priv->manager, priv->unattended);
 
 	page_data = page_table;
 	for (; page_data->page_id != NULL; ++page_data) {
@@ -358,8 +539,40 @@ gis_assistant_init (GisAssistant *assistant)
 		gis_assistant_add_page (assistant, page);
 	}
 
+	if (!priv->unattended)
+		g_idle_add ((GSourceFunc) change_current_page_idle, assistant);
+}
+
+static void
+gis_assistant_init (GisAssistant *assistant)
+{
+	GisAssistantPrivate *priv;
+
+	priv = assistant->priv = gis_assistant_get_instance_private (assistant);
+
+	priv->preseed_file = NULL;
+	priv->unattended = FALSE;
+	priv->relabel_id = 0;
+	priv->update_tick_id = 0;
+	priv->pending_updates = 0;
+
+	priv->pages = g_array_new (FALSE, TRUE, sizeof (PageEntry));
+	priv->first_page = -1;
+	priv->current_index = -1;
+
+	gtk_widget_init_template (GTK_WIDGET (assistant));
+
+	gis_assistant_ui_setup (assistant);
+
+	if (gdk_screen_width() < 1028)
+		gtk_widget_set_size_request (GTK_WIDGET (priv->right), 500, 500);
+
+	priv->manager = gis_page_manager_new ();
+
 	g_signal_connect (priv->manager, "go-next", G_CALLBACK (go_next_page_cb), assistant);
 	g_signal_connect (priv->manager, "locale-changed", G_CALLBACK (locale_changed_cb), assistant);
+	g_signal_connect (priv->manager, "notify::network-available",
+                      G_CALLBACK (network_available_changed_cb), assistant);
 
 	g_signal_connect (priv->stack, "notify::visible-child",
                       G_CALLBACK (current_page_changed_cb), assistant);
@@ -368,8 +581,6 @@ gis_assistant_init (GisAssistant *assistant)
 	g_signal_connect (priv->backward, "clicked", G_CALLBACK (go_backward_button_cb), assistant);
 	g_signal_connect (priv->skip, "clicked", G_CALLBACK (go_forward_button_cb), assistant);
 	g_signal_connect (priv->done, "clicked", G_CALLBACK (done_button_clicked_cb), assistant);
-
-	g_idle_add ((GSourceFunc) change_current_page_idle, assistant);
 }
 
 static void
@@ -377,7 +588,10 @@ gis_assistant_class_init (GisAssistantClass *klass)
 {
 	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
+	gobject_class->constructed = gis_assistant_constructed;
 	gobject_class->finalize = gis_assistant_finalize;
+	gobject_class->get_property = gis_assistant_get_property;
+	gobject_class->set_property = gis_assistant_set_property;
 
 	gtk_widget_class_set_template_from_resource (GTK_WIDGET_CLASS (klass),
                                                  "/kr/gooroom/initial-setup/gis-assistant.ui");
@@ -390,23 +604,46 @@ gis_assistant_class_init (GisAssistantClass *klass)
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisAssistant, skip);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisAssistant, title);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisAssistant, logo_image);
+
+	obj_props[PROP_PRESEED_FILE] =
+		g_param_spec_string ("preseed-file", "", "", NULL,
+				G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+	obj_props[PROP_UNATTENDED] =
+		g_param_spec_boolean ("unattended", "", "", FALSE,
+				G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+	g_object_class_install_properties (gobject_class, PROP_LAST, obj_props);
 }
 
 GtkWidget *
-gis_assistant_new (void)
+gis_assistant_new (const gchar *preseed_file,
+                   gboolean     unattended)
 {
-	return g_object_new (GIS_TYPE_ASSISTANT, NULL);
+	return g_object_new (GIS_TYPE_ASSISTANT,
+                         "preseed-file", preseed_file,
+                         "unattended", unattended,
+                         NULL);
+}
+
+GisPageManager *
+gis_assistant_get_page_manager (GisAssistant *assistant)
+{
+	return assistant->priv->manager;
 }
 
 void
 gis_assistant_add_page (GisAssistant *assistant,
                         GisPage      *page)
 {
+	PageEntry entry = { page, FALSE, -1, -1 };
 	GisAssistantPrivate *priv = assistant->priv;
 
-	priv->pages = g_list_append (priv->pages, page);
+	g_array_append_val (priv->pages, entry);
+	update_page_visibility (assistant);
 
-	g_signal_connect (page, "notify", G_CALLBACK (page_notify_cb), assistant);
+	g_signal_connect (page, "notify::title", G_CALLBACK (page_title_changed_cb), assistant);
+	g_signal_connect (page, "notify::complete", G_CALLBACK (page_navigation_changed_cb), assistant);
+	g_signal_connect (page, "notify::skippable", G_CALLBACK (page_navigation_changed_cb), assistant);
 
 	gtk_container_add (GTK_CONTAINER (priv->stack), GTK_WIDGET (page));
 
@@ -431,10 +668,59 @@ gis_assistant_get_title (GisAssistant *assistant)
 		return "";
 }
 
+static gboolean
+relabel_pages_idle (gpointer user_data)
+{
+	guint i;
+	GisAssistant *assistant = GIS_ASSISTANT (user_data);
+	GisAssistantPrivate *priv = assistant->priv;
+
+	/* one page per iteration, so input and redraws get in between */
+	for (i = 0; i < priv->pages->len; i++) {
+		GisPage *page = PAGE_ENTRY (priv, i)->page;
+		if (gis_page_get_locale_dirty (page)) {
+			gis_page_locale_changed (page);
+			return G_SOURCE_CONTINUE;
+		}
+	}
+
+	priv->relabel_id = 0;
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+warm_translations_thread (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+	/* the first lookup in a domain opens and maps its catalog for the
+	 * new locale; do that here rather than in the first label update */
+	g_dgettext (GETTEXT_PACKAGE, "");
+	g_dgettext ("gtk30", "");
+	g_dgettext ("gnome-online-accounts", "");
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+warm_translations_done_cb (GObject      *source_object,
+                           GAsyncResult *res,
+                           gpointer      user_data)
+{
+	GisAssistant *assistant = GIS_ASSISTANT (source_object);
+	GisAssistantPrivate *priv = assistant->priv;
+
+	if (priv->relabel_id == 0)
+		priv->relabel_id = g_idle_add_full (G_PRIORITY_LOW, relabel_pages_idle, assistant, NULL);
+}
+
 void
 gis_assistant_locale_changed (GisAssistant *assistant)
 {
-	GList *l = NULL;
+	guint i;
+	GTask *task;
 	GisAssistantPrivate *priv = assistant->priv;
 
 	gtk_button_set_label (GTK_BUTTON (priv->backward), _("Prev"));
@@ -442,11 +728,26 @@ gis_assistant_locale_changed (GisAssistant *assistant)
 	gtk_button_set_label (GTK_BUTTON (priv->skip), _("Skip"));
 	gtk_button_set_label (GTK_BUTTON (priv->done), _("Done"));
 
-	update_titlebar (assistant);
+	/* only the visible page is relabeled right away; the others are
+	 * done when they are shown or once the main loop is idle */
+	for (i = 0; i < priv->pages->len; i++) {
+		GisPage *page = PAGE_ENTRY (priv, i)->page;
+		if (page == priv->current_page)
+			gis_page_locale_changed (page);
+		else
+			gis_page_queue_locale_changed (page);
+	}
 
-	priv->pages = g_list_first (priv->pages);
-	for (l = priv->pages; l; l = l->next)
-		gis_page_locale_changed (l->data);
+	queue_update (assistant, UPDATE_TITLEBAR);
+
+	if (priv->relabel_id > 0) {
+		g_source_remove (priv->relabel_id);
+		priv->relabel_id = 0;
+	}
+
+	task = g_task_new (assistant, NULL, warm_translations_done_cb, NULL);
+	g_task_run_in_thread (task, warm_translations_thread);
+	g_object_unref (task);
 }
 
 void
@@ -477,11 +778,9 @@ gis_assistant_prev_page (GisAssistant *assistant)
 void
 gis_assistant_save_data (GisAssistant *assistant)
 {
-	GList *l = NULL;
+	guint i;
 	GisAssistantPrivate *priv = assistant->priv;
 
-	priv->pages = g_list_first (priv->pages);
-	for (l = priv->pages; l; l = l->next) {
-		gis_page_save_data (l->data);
-	}
+	for (i = 0; i < priv->pages->len; i++)
+		gis_page_save_data (PAGE_ENTRY (priv, i)->page);
 }
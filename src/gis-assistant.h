@@ -55,7 +55,8 @@ struct _GisAssistantClass
 
 GType        gis_assistant_get_type          (void) G_GNUC_CONST;
 
-GtkWidget   *gis_assistant_new               (void);
+GtkWidget   *gis_assistant_new               (const gchar  *preseed_file,
+                                              gboolean      unattended);
 
 void         gis_assistant_add_page          (GisAssistant *assistant,
                                               GisPage      *page);
@@ -67,6 +68,7 @@ void         gis_assistant_locale_changed    (GisAssistant *assistant);
 
 const gchar *gis_assistant_get_title         (GisAssistant *assistant);
 GisPage     *gis_assistant_get_current_page  (GisAssistant *assistant);
+GisPageManager *gis_assistant_get_page_manager (GisAssistant *assistant);
 
 G_END_DECLS
 
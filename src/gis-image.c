@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * The artwork is rendered to PNG at build time, once per scale factor
+ * we ship (see images_png in Makefile.am), and stored in the resource
+ * bundle next to the SVG it came from:
+ *
+ *   /kr/gooroom/initial-setup/images/<name>@<scale>x.png
+ *   /kr/gooroom/initial-setup/images/<name>.svg
+ *
+ * Only a scale without a PNG goes through the SVG loader.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gis-image.h"
+
+#define IMAGES_PATH "/kr/gooroom/initial-setup/images/"
+
+typedef struct {
+	gchar *name;
+	gint   width;
+	gint   height;
+} ImageData;
+
+
+/* @width and @height are in application pixels, the pixbuf is @scale
+ * times as large */
+GdkPixbuf *
+gis_image_load_pixbuf (const gchar *name,
+                       gint         width,
+                       gint         height,
+                       gint         scale)
+{
+	gchar *path;
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+
+	path = g_strdup_printf (IMAGES_PATH "%s@%dx.png", name, scale);
+	pixbuf = gdk_pixbuf_new_from_resource (path, NULL);
+	g_free (path);
+
+	if (pixbuf)
+		return pixbuf;
+
+	g_debug ("No %dx rendering of %s, using the SVG", scale, name);
+
+	path = g_strdup_printf (IMAGES_PATH "%s.svg", name);
+	pixbuf = gdk_pixbuf_new_from_resource_at_scale (path, width * scale, height * scale,
+                                                    FALSE, &error);
+	if (pixbuf == NULL) {
+		g_warning ("Failed to load %s: %s", path, error->message);
+		g_error_free (error);
+	}
+	g_free (path);
+
+	return pixbuf;
+}
+
+static void
+update_image (GtkImage  *image,
+              ImageData *data)
+{
+	gint scale;
+	GdkPixbuf *pixbuf;
+	cairo_surface_t *surface;
+
+	scale = gtk_widget_get_scale_factor (GTK_WIDGET (image));
+
+	pixbuf = gis_image_load_pixbuf (data->name, data->width, data->height, scale);
+	if (pixbuf == NULL)
+		return;
+
+	surface = gdk_cairo_surface_create_from_pixbuf (pixbuf, scale, NULL);
+	gtk_image_set_from_surface (image, surface);
+
+	cairo_surface_destroy (surface);
+	g_object_unref (pixbuf);
+}
+
+static void
+scale_factor_changed_cb (GtkImage   *image,
+                         GParamSpec *pspec,
+                         gpointer    user_data)
+{
+	update_image (image, user_data);
+}
+
+static void
+image_data_free (gpointer user_data)
+{
+	ImageData *data = user_data;
+
+	g_free (data->name);
+	g_free (data);
+}
+
+/* Shows @name at the widget's scale factor and follows it when the
+ * window moves to a monitor with another scale */
+void
+gis_image_set_from_name (GtkImage    *image,
+                         const gchar *name,
+                         gint         width,
+                         gint         height)
+{
+	ImageData *data;
+
+	g_return_if_fail (GTK_IS_IMAGE (image));
+
+	data = g_object_get_data (G_OBJECT (image), "gis-image-data");
+	if (data == NULL) {
+		data = g_new0 (ImageData, 1);
+		g_object_set_data_full (G_OBJECT (image), "gis-image-data", data, image_data_free);
+		g_signal_connect (image, "notify::scale-factor",
+                          G_CALLBACK (scale_factor_changed_cb), data);
+	}
+
+	g_free (data->name);
+	data->name = g_strdup (name);
+	data->width = width;
+	data->height = height;
+
+	update_image (image, data);
+}
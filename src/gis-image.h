@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GIS_IMAGE_H__
+#define __GIS_IMAGE_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+GdkPixbuf *gis_image_load_pixbuf (const gchar *name,
+                                  gint         width,
+                                  gint         height,
+                                  gint         scale);
+
+void       gis_image_set_from_name (GtkImage    *image,
+                                    const gchar *name,
+                                    gint         width,
+                                    gint         height);
+
+G_END_DECLS
+
+#endif /* __GIS_IMAGE_H__ */
@@ -41,88 +41,580 @@
  * exist yet.
  */
 
-void
-gis_ensure_login_keyring ()
+#define KEYRING_PROBE_TIMEOUT 1000
+
+typedef struct {
+	gint64 start_time;
+	GDBusConnection *bus;
+	GSubprocess *subprocess;
+} EnsureKeyringData;
+
+static void
+ensure_keyring_done (EnsureKeyringData *data,
+                     const gchar       *result)
+{
+	g_debug ("Login keyring: %s (%.1f ms)", result,
+             (g_get_monotonic_time () - data->start_time) / 1000.0);
+
+	g_clear_object (&data->bus);
+	g_clear_object (&data->subprocess);
+	g_free (data);
+}
+
+static void
+keyring_daemon_unlocked_cb (GObject      *source_object,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+	GError *error = NULL;
+	EnsureKeyringData *data = user_data;
+
+	if (!g_subprocess_communicate_utf8_finish (G_SUBPROCESS (source_object), res, NULL, NULL, &error)) {
+		g_warning ("Failed to communicate with gnome-keyring-daemon: %s", error->message);
+		g_error_free (error);
+		ensure_keyring_done (data, "unlock failed");
+		return;
+	}
+
+	ensure_keyring_done (data, "unlocked by gnome-keyring-daemon --unlock");
+}
+
+static void
+spawn_keyring_daemon (EnsureKeyringData *data)
 {
-	GSubprocess *subprocess = NULL;
-	GSubprocessLauncher *launcher = NULL;
+	GSubprocessLauncher *launcher;
 	GError *error = NULL;
 
 	g_debug ("launching gnome-keyring-daemon --unlock");
 	launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_SILENCE);
-	subprocess = g_subprocess_launcher_spawn (launcher, &error, "gnome-keyring-daemon", "--unlock", NULL);
-	if (subprocess == NULL) {
+	data->subprocess = g_subprocess_launcher_spawn (launcher, &error, "gnome-keyring-daemon", "--unlock", NULL);
+	g_object_unref (launcher);
+
+	if (data->subprocess == NULL) {
 		g_warning ("Failed to spawn gnome-keyring-daemon --unlock: %s", error->message);
 		g_error_free (error);
-		goto out;
+		ensure_keyring_done (data, "spawn failed");
+		return;
 	}
 
-	if (!g_subprocess_communicate_utf8 (subprocess, DUMMY_PWD, NULL, NULL, NULL, &error)) {
-		g_warning ("Failed to communicate with gnome-keyring-daemon: %s", error->message);
-		g_error_free (error);
-		goto out;
+	g_subprocess_communicate_utf8_async (data->subprocess, DUMMY_PWD, NULL,
+                                         keyring_daemon_unlocked_cb, data);
+}
+
+static void
+login_collection_locked_cb (GObject      *source_object,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+	GVariant *ret, *value;
+	gboolean locked = TRUE;
+	EnsureKeyringData *data = user_data;
+
+	/* fails as well when there is no login collection yet */
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, NULL);
+	if (ret) {
+		g_variant_get (ret, "(v)", &value);
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+			locked = g_variant_get_boolean (value);
+		g_variant_unref (value);
+		g_variant_unref (ret);
+	}
+
+	if (!locked) {
+		ensure_keyring_done (data, "reusing the running, unlocked daemon");
+		return;
 	}
 
-out:
-	if (subprocess)
-		g_object_unref (subprocess);
-	if (launcher)
-		g_object_unref (launcher);
+	spawn_keyring_daemon (data);
 }
 
-void
-gis_update_login_keyring_password (const gchar *new_)
+static void
+secrets_name_owner_cb (GObject      *source_object,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+	GVariant *ret;
+	gboolean has_owner = FALSE;
+	EnsureKeyringData *data = user_data;
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, NULL);
+	if (ret) {
+		g_variant_get (ret, "(b)", &has_owner);
+		g_variant_unref (ret);
+	}
+
+	if (!has_owner) {
+		g_debug ("No Secret Service on the session bus");
+		spawn_keyring_daemon (data);
+		return;
+	}
+
+	g_dbus_connection_call (data->bus,
+                            "org.freedesktop.secrets",
+                            "/org/freedesktop/secrets/collection/login",
+                            "org.freedesktop.DBus.Properties",
+                            "Get",
+                            g_variant_new ("(ss)", "org.freedesktop.Secret.Collection", "Locked"),
+                            G_VARIANT_TYPE ("(v)"),
+                            G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                            KEYRING_PROBE_TIMEOUT,
+                            NULL,
+                            login_collection_locked_cb,
+                            data);
+}
+
+static void
+session_bus_cb (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
 {
-	GDBusConnection *bus = NULL;
-	SecretService *service = NULL;
-	SecretValue *old_secret = NULL;
-	SecretValue *new_secret = NULL;
 	GError *error = NULL;
-	
-	service = secret_service_get_sync (SECRET_SERVICE_OPEN_SESSION, NULL, &error);
-	if (service == NULL) {
-		g_warning ("Failed to get secret service: %s", error->message);
+	EnsureKeyringData *data = user_data;
+
+	data->bus = g_bus_get_finish (res, &error);
+	if (data->bus == NULL) {
+		g_warning ("Failed to get session bus: %s", error->message);
 		g_error_free (error);
-		goto out;
+		spawn_keyring_daemon (data);
+		return;
 	}
 
-	bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
-	if (bus == NULL) {
-		g_warning ("Failed to get session bus: %s", error->message);
+	/* checking for an owner does not activate the service */
+	g_dbus_connection_call (data->bus,
+                            "org.freedesktop.DBus",
+                            "/org/freedesktop/DBus",
+                            "org.freedesktop.DBus",
+                            "NameHasOwner",
+                            g_variant_new ("(s)", "org.freedesktop.secrets"),
+                            G_VARIANT_TYPE ("(b)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            KEYRING_PROBE_TIMEOUT,
+                            NULL,
+                            secrets_name_owner_cb,
+                            data);
+}
+
+/* The session usually starts the keyring already; only when there is
+ * no unlocked login keyring is the daemon asked to unlock one. This
+ * returns right away, the probe runs from the main loop. */
+void
+gis_ensure_login_keyring ()
+{
+	EnsureKeyringData *data;
+
+	data = g_new0 (EnsureKeyringData, 1);
+	data->start_time = g_get_monotonic_time ();
+
+	g_bus_get (G_BUS_TYPE_SESSION, NULL, session_bus_cb, data);
+}
+
+/* A wedged daemon must not hold up provisioning forever: every call
+ * gets a bounded timeout and is retried a few times with a growing
+ * delay before giving up. */
+#define KEYRING_CALL_TIMEOUT  (10 * 1000)
+#define KEYRING_MAX_ATTEMPTS  3
+#define KEYRING_RETRY_DELAY   500
+
+typedef struct {
+	gchar *old_password;
+	gchar *password;
+	guint attempt;
+	SecretService *service;
+	GDBusConnection *bus;
+} UpdatePasswordData;
+
+static void update_password_attempt (GTask *task);
+
+static void
+clear_password (gchar **password)
+{
+	if (*password) {
+		memset (*password, 0, strlen (*password));
+		g_clear_pointer (password, g_free);
+	}
+}
+
+static void
+update_password_data_free (gpointer data)
+{
+	UpdatePasswordData *d = data;
+
+	clear_password (&d->old_password);
+	clear_password (&d->password);
+	g_clear_object (&d->service);
+	g_clear_object (&d->bus);
+	g_free (d);
+}
+
+static gboolean
+is_retryable (const GError *error)
+{
+	return g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+           g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY) ||
+           g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_TIMEOUT) ||
+           g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN);
+}
+
+static gboolean
+retry_attempt_cb (gpointer user_data)
+{
+	update_password_attempt (G_TASK (user_data));
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+attempt_failed (GTask  *task,
+                GError *error)
+{
+	UpdatePasswordData *d = g_task_get_task_data (task);
+
+	if (d->attempt < KEYRING_MAX_ATTEMPTS && is_retryable (error) &&
+        !g_cancellable_is_cancelled (g_task_get_cancellable (task))) {
+		g_debug ("Keyring password change attempt %u failed, retrying: %s",
+                 d->attempt, error->message);
 		g_error_free (error);
-		goto out;
-	}
-
-	old_secret = secret_value_new (DUMMY_PWD, strlen (DUMMY_PWD), "text/plain");
-	new_secret = secret_value_new (new_, strlen (new_), "text/plain");
-
-	g_dbus_connection_call_sync (bus,
-                                     "org.gnome.keyring",
-                                     "/org/freedesktop/secrets",
-                                     "org.gnome.keyring.InternalUnsupportedGuiltRiddenInterface",
-                                     "ChangeWithMasterPassword",
-                                     g_variant_new ("(o@(oayays)@(oayays))",
-                                                    "/org/freedesktop/secrets/collection/login",
-                                                    secret_service_encode_dbus_secret (service, old_secret),
-                                                    secret_service_encode_dbus_secret (service, new_secret)),
-                                     NULL,
-                                     0,
-                                     G_MAXINT,
-                                     NULL, &error);
-
-        if (error != NULL) {
-          g_warning ("Failed to change keyring password: %s", error->message);
-          g_error_free (error);
-        }
-
-out:
-
-	if (service)
-		g_object_unref (service);
-	if (bus)
-		g_object_unref (bus);
-	if (old_secret)
-		secret_value_unref (old_secret);
-	if (new_secret)
-		secret_value_unref (new_secret);
+		g_timeout_add_full (G_PRIORITY_DEFAULT, KEYRING_RETRY_DELAY * d->attempt,
+                            retry_attempt_cb, task, g_object_unref);
+		return;
+	}
+
+	g_task_return_error (task, error);
+	g_object_unref (task);
+}
+
+static void
+change_password_cb (GObject      *source_object,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+	GVariant *ret;
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (ret == NULL) {
+		attempt_failed (task, error);
+		return;
+	}
+
+	g_variant_unref (ret);
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+static void
+call_change_password (GTask *task)
+{
+	SecretValue *old_secret, *new_secret;
+	UpdatePasswordData *d = g_task_get_task_data (task);
+
+	old_secret = secret_value_new (d->old_password, strlen (d->old_password), "text/plain");
+	new_secret = secret_value_new (d->password, strlen (d->password), "text/plain");
+
+	g_dbus_connection_call (d->bus,
+                            "org.gnome.keyring",
+                            "/org/freedesktop/secrets",
+                            "org.gnome.keyring.InternalUnsupportedGuiltRiddenInterface",
+                            "ChangeWithMasterPassword",
+                            g_variant_new ("(o@(oayays)@(oayays))",
+                                           "/org/freedesktop/secrets/collection/login",
+                                           secret_service_encode_dbus_secret (d->service, old_secret),
+                                           secret_service_encode_dbus_secret (d->service, new_secret)),
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            KEYRING_CALL_TIMEOUT,
+                            g_task_get_cancellable (task),
+                            change_password_cb,
+                            task);
+
+	secret_value_unref (old_secret);
+	secret_value_unref (new_secret);
+}
+
+static void
+bus_get_cb (GObject      *source_object,
+            GAsyncResult *res,
+            gpointer      user_data)
+{
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	UpdatePasswordData *d = g_task_get_task_data (task);
+
+	d->bus = g_bus_get_finish (res, &error);
+	if (d->bus == NULL) {
+		attempt_failed (task, error);
+		return;
+	}
+
+	call_change_password (task);
+}
+
+static void
+service_get_cb (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	UpdatePasswordData *d = g_task_get_task_data (task);
+
+	d->service = secret_service_get_finish (res, &error);
+	if (d->service == NULL) {
+		attempt_failed (task, error);
+		return;
+	}
+
+	g_bus_get (G_BUS_TYPE_SESSION, g_task_get_cancellable (task), bus_get_cb, task);
+}
+
+static void
+update_password_attempt (GTask *task)
+{
+	UpdatePasswordData *d = g_task_get_task_data (task);
+
+	d->attempt++;
+
+	/* the attempt owns a reference until it returns or reschedules */
+	g_object_ref (task);
+
+	/* a retry only redoes the steps that have not succeeded yet */
+	if (d->service && d->bus)
+		call_change_password (task);
+	else if (d->service)
+		g_bus_get (G_BUS_TYPE_SESSION, g_task_get_cancellable (task), bus_get_cb, task);
+	else
+		secret_service_get (SECRET_SERVICE_OPEN_SESSION, g_task_get_cancellable (task),
+                            service_get_cb, task);
+}
+
+/* @old is the keyring's current password and @new_ the one to set;
+ * NULL stands for the password the keyring was created with */
+void
+gis_update_login_keyring_password_async (const gchar         *old,
+                                         const gchar         *new_,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+	GTask *task;
+	UpdatePasswordData *d;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, gis_update_login_keyring_password_async);
+
+	d = g_new0 (UpdatePasswordData, 1);
+	d->old_password = g_strdup (old ? old : DUMMY_PWD);
+	d->password = g_strdup (new_ ? new_ : DUMMY_PWD);
+	g_task_set_task_data (task, d, update_password_data_free);
+
+	update_password_attempt (task);
+
+	g_object_unref (task);
+}
+
+gboolean
+gis_update_login_keyring_password_finish (GAsyncResult  *result,
+                                          GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+typedef struct {
+	SecretService *service;
+	GDBusConnection *bus;
+} ResetKeyringData;
+
+static void
+reset_keyring_data_free (gpointer data)
+{
+	ResetKeyringData *d = data;
+
+	g_clear_object (&d->service);
+	g_clear_object (&d->bus);
+	g_free (d);
+}
+
+static void
+reset_failed (GTask  *task,
+              GError *error)
+{
+	g_task_return_error (task, error);
+	g_object_unref (task);
+}
+
+static void
+set_alias_cb (GObject      *source_object,
+              GAsyncResult *res,
+              gpointer      user_data)
+{
+	GVariant *ret;
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (ret == NULL) {
+		reset_failed (task, error);
+		return;
+	}
+
+	g_variant_unref (ret);
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+static void
+login_collection_created_cb (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+	GVariant *ret;
+	const gchar *collection;
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	ResetKeyringData *d = g_task_get_task_data (task);
+
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (ret == NULL) {
+		reset_failed (task, error);
+		return;
+	}
+
+	g_variant_get (ret, "(&o)", &collection);
+
+	g_dbus_connection_call (d->bus,
+                            "org.freedesktop.secrets",
+                            "/org/freedesktop/secrets",
+                            "org.freedesktop.Secret.Service",
+                            "SetAlias",
+                            g_variant_new ("(so)", "login", collection),
+                            NULL,
+                            G_DBUS_CALL_FLAGS_NONE,
+                            KEYRING_CALL_TIMEOUT,
+                            g_task_get_cancellable (task),
+                            set_alias_cb,
+                            task);
+
+	g_variant_unref (ret);
+}
+
+static void
+login_collection_deleted_cb (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+	GVariant *ret, *properties;
+	GVariantBuilder builder;
+	SecretValue *secret;
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	ResetKeyringData *d = g_task_get_task_data (task);
+
+	/* there may have been no login keyring at all */
+	ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &error);
+	if (ret == NULL) {
+		g_debug ("Login keyring not deleted: %s", error->message);
+		g_clear_error (&error);
+	} else {
+		g_variant_unref (ret);
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", "org.freedesktop.Secret.Collection.Label",
+                           g_variant_new_string ("Login"));
+	properties = g_variant_builder_end (&builder);
+
+	secret = secret_value_new (DUMMY_PWD, strlen (DUMMY_PWD), "text/plain");
+
+	g_dbus_connection_call (d->bus,
+                            "org.gnome.keyring",
+                            "/org/freedesktop/secrets",
+                            "org.gnome.keyring.InternalUnsupportedGuiltRiddenInterface",
+                            "CreateWithMasterPassword",
+                            g_variant_new ("(@a{sv}@(oayays))",
+                                           properties,
+                                           secret_service_encode_dbus_secret (d->service, secret)),
+                            G_VARIANT_TYPE ("(o)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            KEYRING_CALL_TIMEOUT,
+                            g_task_get_cancellable (task),
+                            login_collection_created_cb,
+                            task);
+
+	secret_value_unref (secret);
+}
+
+static void
+reset_bus_get_cb (GObject      *source_object,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	ResetKeyringData *d = g_task_get_task_data (task);
+
+	d->bus = g_bus_get_finish (res, &error);
+	if (d->bus == NULL) {
+		reset_failed (task, error);
+		return;
+	}
+
+	g_dbus_connection_call (d->bus,
+                            "org.freedesktop.secrets",
+                            "/org/freedesktop/secrets/collection/login",
+                            "org.freedesktop.Secret.Collection",
+                            "Delete",
+                            NULL,
+                            G_VARIANT_TYPE ("(o)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            KEYRING_CALL_TIMEOUT,
+                            g_task_get_cancellable (task),
+                            login_collection_deleted_cb,
+                            task);
+}
+
+static void
+reset_service_get_cb (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	ResetKeyringData *d = g_task_get_task_data (task);
+
+	d->service = secret_service_get_finish (res, &error);
+	if (d->service == NULL) {
+		reset_failed (task, error);
+		return;
+	}
+
+	g_bus_get (G_BUS_TYPE_SESSION, g_task_get_cancellable (task), reset_bus_get_cb, task);
+}
+
+/* Replaces the login keyring, and whatever it held, with an empty one
+ * that has the password it was created with. For when its current
+ * password is not known any more. */
+void
+gis_reset_login_keyring_async (GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data)
+{
+	GTask *task;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, gis_reset_login_keyring_async);
+	g_task_set_task_data (task, g_new0 (ResetKeyringData, 1), reset_keyring_data_free);
+
+	secret_service_get (SECRET_SERVICE_OPEN_SESSION, cancellable, reset_service_get_cb, task);
+}
+
+gboolean
+gis_reset_login_keyring_finish (GAsyncResult  *result,
+                                GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
 }
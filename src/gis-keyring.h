@@ -22,11 +22,23 @@
 #define __GIS_KEYRING_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
 void	gis_ensure_login_keyring	  ();
-void	gis_update_login_keyring_password (const gchar *new_);
+void	gis_update_login_keyring_password_async  (const gchar         *old,
+                                                  const gchar         *new_,
+                                                  GCancellable        *cancellable,
+                                                  GAsyncReadyCallback  callback,
+                                                  gpointer             user_data);
+gboolean	gis_update_login_keyring_password_finish (GAsyncResult  *result,
+                                                  GError       **error);
+void	gis_reset_login_keyring_async            (GCancellable        *cancellable,
+                                                  GAsyncReadyCallback  callback,
+                                                  gpointer             user_data);
+gboolean	gis_reset_login_keyring_finish           (GAsyncResult        *result,
+                                                  GError             **error);
 
 G_END_DECLS
 
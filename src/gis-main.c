@@ -29,6 +29,18 @@
 #include "gis-keyring.h"
 #include "gis-assistant.h"
 
+
+static gchar *preseed_file = NULL;
+static gboolean unattended = FALSE;
+static gint unattended_status = EXIT_SUCCESS;
+
+static GOptionEntry option_entries[] =
+{
+	{ "preseed",    'p', 0, G_OPTION_ARG_FILENAME, &preseed_file, N_("Read the setup data from FILE"), N_("FILE") },
+	{ "unattended", 0,   0, G_OPTION_ARG_NONE,     &unattended,   N_("Run the setup without any user interaction"), NULL },
+	{ NULL }
+};
+
 static void
 ensure_nm_applet (void)
 {
@@ -104,12 +116,59 @@ init_config_files (void)
 	g_free (dirname);
 	g_dir_close (dir);
 }
+
+static void
+unattended_done_cb (GisPageManager *manager, gboolean success, gpointer user_data)
+{
+	GApplication *app = G_APPLICATION (user_data);
+
+	unattended_status = success ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	g_application_release (app);
+	g_application_quit (app);
+}
+
+static void
+run_unattended (GtkApplication *app)
+{
+	GtkWidget *assistant;
+	GError *error = NULL;
+	GisPageManager *manager;
+
+	/* No window is ever mapped: the assistant is only used to drive
+	 * the pages' save_data handlers with the preseeded values. */
+	assistant = gis_assistant_new (preseed_file, TRUE);
+	g_object_ref_sink (assistant);
+
+	manager = gis_assistant_get_page_manager (GIS_ASSISTANT (assistant));
+
+	if (!gis_page_manager_check_preseed (manager, &error)) {
+		g_warning ("Invalid preseed file '%s': %s", preseed_file, error->message);
+		g_error_free (error);
+		gtk_widget_destroy (assistant);
+		g_object_unref (assistant);
+		unattended_status = EXIT_FAILURE;
+		return;
+	}
+
+	g_signal_connect (manager, "unattended-done", G_CALLBACK (unattended_done_cb), app);
+
+	g_application_hold (G_APPLICATION (app));
+
+	gis_assistant_save_data (GIS_ASSISTANT (assistant));
+}
+
 static void
 on_activate (GtkApplication *app, gpointer user_data)
 {
 	GtkCssProvider *provider;
 	GtkWidget *window, *assistant;
 
+	if (unattended) {
+		run_unattended (app);
+		return;
+	}
+
 	window = gtk_application_window_new (app);
 	gtk_window_set_type_hint (GTK_WINDOW (window), GDK_WINDOW_TYPE_HINT_DESKTOP);
 	gtk_window_set_keep_below (GTK_WINDOW (window), TRUE);
@@ -135,7 +194,7 @@ on_activate (GtkApplication *app, gpointer user_data)
 		gtk_widget_set_visual (window, visual);
 	}
 
-	assistant = gis_assistant_new ();
+	assistant = gis_assistant_new (preseed_file, FALSE);
 	//gtk_widget_set_halign (assistant, GTK_ALIGN_CENTER);
 	//gtk_widget_set_valign (assistant, GTK_ALIGN_CENTER);
 	gtk_widget_show (assistant);
@@ -157,6 +216,8 @@ int
 main (int argc, char **argv)
 {
 	GtkApplication *app;
+	GOptionContext *context;
+	GError *error = NULL;
 
 	int ret = EXIT_SUCCESS;
 
@@ -166,6 +227,22 @@ main (int argc, char **argv)
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 	textdomain (GETTEXT_PACKAGE);
 
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, option_entries, GETTEXT_PACKAGE);
+	g_option_context_set_ignore_unknown_options (context, TRUE);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	if (unattended && !preseed_file) {
+		g_warning ("--unattended requires a preseed file");
+		return EXIT_FAILURE;
+	}
+
 	init_config_files ();
 	ensure_nm_applet ();
 	gis_ensure_login_keyring ();
@@ -175,6 +252,11 @@ main (int argc, char **argv)
 
 	ret = g_application_run (G_APPLICATION (app), argc, argv);
 	g_object_unref (app);
+
+	if (unattended && ret == EXIT_SUCCESS)
+		ret = unattended_status;
+
+	g_free (preseed_file);
 //	sigterm_cb (GINT_TO_POINTER (FALSE));
 
     return ret;
@@ -24,13 +24,18 @@
 
 
 #include <locale.h>
+#include <string.h>
 
 #include "gis-page-manager.h"
+#include "gis-system-info.h"
+#include "pages/account/um-utils.h"
+#include "pages/account/pw-utils.h"
 
 
 enum {
 	GO_NEXT,
 	LOCALE_CHANGED,
+	UNATTENDED_DONE,
 	LAST_SIGNAL
 };
 
@@ -44,8 +49,16 @@ struct _GisPageManagerPrivate {
 	gchar *language;
 
 	gboolean network_available;
+	gboolean unattended;
 
 	GList *online_accounts;
+	GHashTable *online_account_types; /* provider type -> name in online_accounts */
+
+	gchar **groups;
+
+	GKeyFile *preseed;
+
+	GisSystemInfo *system_info;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GisPageManager, gis_page_manager, G_TYPE_OBJECT)
@@ -70,12 +83,20 @@ gis_page_manager_finalize (GObject *object)
 	g_free (priv->username);
 	g_free (priv->password);
 	g_free (priv->language);
+	g_strfreev (priv->groups);
+
+	g_clear_object (&priv->system_info);
+
+	if (priv->preseed)
+		g_key_file_free (priv->preseed);
 
 	if (priv->online_accounts) {
 		g_list_free_full (priv->online_accounts, (GDestroyNotify) g_free);
 		priv->online_accounts = NULL;
 	}
 
+	g_hash_table_destroy (priv->online_account_types);
+
 	G_OBJECT_CLASS (gis_page_manager_parent_class)->finalize (object);
 }
 
@@ -130,6 +151,13 @@ gis_page_manager_init (GisPageManager *manager)
 	manager->priv->language = NULL;
 
 	manager->priv->network_available = FALSE;
+	manager->priv->unattended = FALSE;
+	manager->priv->groups = NULL;
+	manager->priv->preseed = NULL;
+	manager->priv->online_account_types = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	/* starts reading the system files right away */
+	manager->priv->system_info = gis_system_info_new ();
 }
 
 static void
@@ -161,6 +189,14 @@ gis_page_manager_class_init (GisPageManagerClass *klass)
                                             g_cclosure_marshal_VOID__VOID,
                                             G_TYPE_NONE, 0);
 
+    signals[UNATTENDED_DONE] = g_signal_new ("unattended-done",
+                                             GIS_TYPE_PAGE_MANAGER,
+                                             G_SIGNAL_RUN_FIRST,
+                                             G_STRUCT_OFFSET (GisPageManagerClass, unattended_done),
+                                             NULL, NULL,
+                                             g_cclosure_marshal_VOID__BOOLEAN,
+                                             G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
 	g_object_class_install_properties (object_class, PROP_LAST, obj_props);
 }
 
@@ -247,6 +283,8 @@ gis_page_manager_set_online_accounts (GisPageManager *manager,
 		priv->online_accounts = NULL;
 	}
 
+	g_hash_table_remove_all (priv->online_account_types);
+
 	manager->priv->online_accounts = online_accounts;
 }
 
@@ -256,6 +294,41 @@ gis_page_manager_get_online_accounts (GisPageManager *manager)
 	return manager->priv->online_accounts;
 }
 
+/* The list holds the provider names for display; they are translated,
+ * so entries are found by the provider type instead. */
+void
+gis_page_manager_add_online_account (GisPageManager *manager,
+                                     const char     *provider_type,
+                                     const char     *name)
+{
+	gchar *copy;
+	GisPageManagerPrivate *priv = manager->priv;
+
+	if (g_hash_table_contains (priv->online_account_types, provider_type))
+		return;
+
+	copy = g_strdup (name);
+	priv->online_accounts = g_list_append (priv->online_accounts, copy);
+	g_hash_table_insert (priv->online_account_types, g_strdup (provider_type), copy);
+}
+
+void
+gis_page_manager_remove_online_account (GisPageManager *manager,
+                                        const char     *provider_type)
+{
+	gchar *name;
+	GisPageManagerPrivate *priv = manager->priv;
+
+	name = g_hash_table_lookup (priv->online_account_types, provider_type);
+	if (name == NULL)
+		return;
+
+	g_hash_table_remove (priv->online_account_types, provider_type);
+
+	priv->online_accounts = g_list_remove (priv->online_accounts, name);
+	g_free (name);
+}
+
 void
 gis_page_manager_set_language (GisPageManager *manager,
                                const char     *language)
@@ -271,3 +344,292 @@ gis_page_manager_get_language (GisPageManager *manager)
 {
 	return (manager->priv->language ? g_strdup (manager->priv->language) : NULL);
 }
+
+/* The chosen language or, until one is chosen, the system default. */
+const gchar *
+gis_page_manager_get_locale (GisPageManager *manager)
+{
+	const gchar *locale;
+	GisPageManagerPrivate *priv = manager->priv;
+
+	if (priv->language)
+		return priv->language;
+
+	if (g_getenv ("LANG"))
+		return g_getenv ("LANG");
+
+	locale = gis_system_info_get_default_locale (priv->system_info);
+
+	return locale ? locale : "C";
+}
+
+/* Shared by all pages; owned by the manager */
+GisSystemInfo *
+gis_page_manager_get_system_info (GisPageManager *manager)
+{
+	return manager->priv->system_info;
+}
+
+void
+gis_page_manager_set_groups (GisPageManager      *manager,
+                             const gchar * const *groups)
+{
+	g_strfreev (manager->priv->groups);
+
+	manager->priv->groups = g_strdupv ((gchar **) groups);
+}
+
+/* Returns NULL if no groups were configured; the caller then falls back to
+ * its built-in list. */
+const gchar * const *
+gis_page_manager_get_groups (GisPageManager *manager)
+{
+	return (const gchar * const *) manager->priv->groups;
+}
+
+/* The account page hides itself when the account is preseeded, so the
+ * checks it would have done on the entries are done here instead */
+static gboolean
+check_preseed_account (GKeyFile  *keyfile,
+                       GError   **error)
+{
+	const gchar *c;
+	gchar *realname, *username, *password;
+	gchar *tip = NULL;
+	const gchar *hint = NULL;
+	gint strength_level = 0;
+	gboolean ret = FALSE;
+
+	realname = g_key_file_get_string (keyfile, "Account", "RealName", NULL);
+	username = g_key_file_get_string (keyfile, "Account", "UserName", NULL);
+	password = g_key_file_get_string (keyfile, "Account", "Password", NULL);
+
+	if (username && !is_valid_username (username, &tip)) {
+		g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                     "[Account] UserName is not valid: %s", tip ? tip : username);
+		goto out;
+	}
+
+	/* ends up in the GECOS field of passwd(5) */
+	if (realname) {
+		if (!g_utf8_validate (realname, -1, NULL)) {
+			g_set_error_literal (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                                 "[Account] RealName is not valid UTF-8");
+			goto out;
+		}
+
+		for (c = realname; *c; c++) {
+			if (*c == ':' || *c == ',' || g_ascii_iscntrl (*c)) {
+				g_set_error_literal (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                                     "[Account] RealName must not contain ':', ',' or control characters");
+				goto out;
+			}
+		}
+	}
+
+	if (password) {
+		pw_strength (password, NULL, username, &hint, &strength_level);
+		if (strength_level <= 1) {
+			g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                         "[Account] Password is too weak%s%s",
+                         hint ? ": " : "", hint ? hint : "");
+			goto out;
+		}
+	}
+
+	ret = TRUE;
+
+out:
+	if (password)
+		memset (password, 0, strlen (password));
+	g_free (realname);
+	g_free (username);
+	g_free (password);
+	g_free (tip);
+
+	return ret;
+}
+
+/*
+ * The preseed file is a GKeyFile, for example:
+ *
+ *   [Language]
+ *   Locale=ko_KR.UTF-8
+ *
+ *   [Eula]
+ *   Accepted=true
+ *
+ *   [Network]
+ *   Connection=Wired connection 1
+ *
+ *   [Account]
+ *   RealName=Gooroom User
+ *   UserName=gooroom
+ *   Password=...
+ *
+ *   [OnlineAccounts]
+ *   Skip=true
+ *
+ *   [Groups]
+ *   Groups=adm;audio;sudo;users;
+ *
+ * Values that are shared between pages are applied to the manager right
+ * away, page specific values are queried by the pages themselves.
+ *
+ * [Language] Locale only selects the language the EULAs are shown in.
+ * The language page is not part of the assistant, so nothing writes it
+ * to the user's session; the account gets the system default locale.
+ *
+ * A file with an account the account page would not accept is rejected.
+ */
+gboolean
+gis_page_manager_load_preseed (GisPageManager  *manager,
+                               const char      *filename,
+                               GError         **error)
+{
+	GKeyFile *keyfile;
+	gchar *value = NULL;
+	gchar **groups = NULL;
+	GisPageManagerPrivate *priv = manager->priv;
+
+	keyfile = g_key_file_new ();
+	if (!g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, error) ||
+        !check_preseed_account (keyfile, error)) {
+		g_key_file_free (keyfile);
+		return FALSE;
+	}
+
+	if (priv->preseed)
+		g_key_file_free (priv->preseed);
+	priv->preseed = keyfile;
+
+	value = g_key_file_get_string (keyfile, "Language", "Locale", NULL);
+	if (value)
+		gis_page_manager_set_language (manager, value);
+	g_free (value);
+
+	if (gis_page_manager_has_preseed (manager, "Account", "UserName") &&
+        gis_page_manager_has_preseed (manager, "Account", "Password")) {
+		gchar *realname, *username, *password;
+
+		realname = g_key_file_get_string (keyfile, "Account", "RealName", NULL);
+		username = g_key_file_get_string (keyfile, "Account", "UserName", NULL);
+		password = g_key_file_get_string (keyfile, "Account", "Password", NULL);
+
+		gis_page_manager_set_user_info (manager, realname, username, password);
+
+		g_free (realname);
+		g_free (username);
+		g_free (password);
+	}
+
+	groups = g_key_file_get_string_list (keyfile, "Groups", "Groups", NULL, NULL);
+	if (groups)
+		gis_page_manager_set_groups (manager, (const gchar * const *) groups);
+	g_strfreev (groups);
+
+	return TRUE;
+}
+
+/* Unattended mode has no one to ask, so everything the account and the
+ * EULA page need must be in the preseed before any page saves */
+gboolean
+gis_page_manager_check_preseed (GisPageManager  *manager,
+                                GError         **error)
+{
+	guint i;
+	GisPageManagerPrivate *priv = manager->priv;
+	static const gchar *required[][2] = {
+		{ "Account", "UserName" },
+		{ "Account", "Password" },
+	};
+
+	if (!priv->preseed) {
+		g_set_error_literal (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_NOT_FOUND,
+                             "No preseed file has been loaded");
+		return FALSE;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (required); i++) {
+		gchar *value;
+
+		value = g_key_file_get_string (priv->preseed, required[i][0], required[i][1], NULL);
+		if (value == NULL || *value == '\0') {
+			g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                         "[%s] %s is missing or empty", required[i][0], required[i][1]);
+			g_free (value);
+			return FALSE;
+		}
+		g_free (value);
+	}
+
+	if (!g_key_file_get_boolean (priv->preseed, "Eula", "Accepted", NULL)) {
+		g_set_error_literal (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                             "[Eula] Accepted must be true");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean
+gis_page_manager_has_preseed (GisPageManager *manager,
+                              const char     *group,
+                              const char     *key)
+{
+	GisPageManagerPrivate *priv = manager->priv;
+
+	if (!priv->preseed)
+		return FALSE;
+
+	if (key == NULL)
+		return g_key_file_has_group (priv->preseed, group);
+
+	return g_key_file_has_key (priv->preseed, group, key, NULL);
+}
+
+gchar *
+gis_page_manager_get_preseed_string (GisPageManager *manager,
+                                     const char     *group,
+                                     const char     *key)
+{
+	GisPageManagerPrivate *priv = manager->priv;
+
+	if (!priv->preseed)
+		return NULL;
+
+	return g_key_file_get_string (priv->preseed, group, key, NULL);
+}
+
+gboolean
+gis_page_manager_get_preseed_boolean (GisPageManager *manager,
+                                      const char     *group,
+                                      const char     *key)
+{
+	GisPageManagerPrivate *priv = manager->priv;
+
+	if (!priv->preseed)
+		return FALSE;
+
+	return g_key_file_get_boolean (priv->preseed, group, key, NULL);
+}
+
+void
+gis_page_manager_set_unattended (GisPageManager *manager,
+                                 gboolean        unattended)
+{
+	manager->priv->unattended = unattended;
+}
+
+gboolean
+gis_page_manager_get_unattended (GisPageManager *manager)
+{
+	return manager->priv->unattended;
+}
+
+void
+gis_page_manager_unattended_done (GisPageManager *manager,
+                                  gboolean        success)
+{
+	g_signal_emit (G_OBJECT (manager), signals[UNATTENDED_DONE], 0, success);
+}
@@ -23,6 +23,8 @@
 
 #include <glib-object.h>
 
+#include "gis-system-info.h"
+
 G_BEGIN_DECLS
 
 #define GIS_TYPE_PAGE_MANAGER         (gis_page_manager_get_type ())
@@ -47,8 +49,10 @@ struct _GisPageManagerClass
 {
 	GObjectClass __parent_class__;
 
-	void (*go_next)        (GisPageManager *manager);
-	void (*locale_changed) (GisPageManager *manager);
+	void (*go_next)          (GisPageManager *manager);
+	void (*locale_changed)   (GisPageManager *manager);
+	void (*unattended_done)  (GisPageManager *manager,
+	                          gboolean        success);
 };
 
 
@@ -77,10 +81,43 @@ gboolean        gis_page_manager_get_network_available (GisPageManager *manager)
 void            gis_page_manager_set_online_accounts (GisPageManager *manager,
                                                       GList          *online_accounts);
 GList          *gis_page_manager_get_online_accounts (GisPageManager *manager);
+void            gis_page_manager_add_online_account    (GisPageManager *manager,
+                                                        const char     *provider_type,
+                                                        const char     *name);
+void            gis_page_manager_remove_online_account (GisPageManager *manager,
+                                                        const char     *provider_type);
 
 void            gis_page_manager_set_language (GisPageManager *manager,
                                                const char     *language);
 char           *gis_page_manager_get_language (GisPageManager *manager);
+const gchar    *gis_page_manager_get_locale   (GisPageManager *manager);
+
+GisSystemInfo  *gis_page_manager_get_system_info (GisPageManager *manager);
+
+void            gis_page_manager_set_groups (GisPageManager      *manager,
+                                             const gchar * const *groups);
+const gchar * const *gis_page_manager_get_groups (GisPageManager *manager);
+
+gboolean        gis_page_manager_load_preseed (GisPageManager  *manager,
+                                               const char      *filename,
+                                               GError         **error);
+gboolean        gis_page_manager_check_preseed (GisPageManager  *manager,
+                                                GError         **error);
+gboolean        gis_page_manager_has_preseed  (GisPageManager  *manager,
+                                               const char      *group,
+                                               const char      *key);
+gchar          *gis_page_manager_get_preseed_string  (GisPageManager *manager,
+                                                      const char     *group,
+                                                      const char     *key);
+gboolean        gis_page_manager_get_preseed_boolean (GisPageManager *manager,
+                                                      const char     *group,
+                                                      const char     *key);
+
+void            gis_page_manager_set_unattended (GisPageManager *manager,
+                                                 gboolean        unattended);
+gboolean        gis_page_manager_get_unattended (GisPageManager *manager);
+void            gis_page_manager_unattended_done (GisPageManager *manager,
+                                                  gboolean        success);
 
 
 G_END_DECLS
@@ -34,6 +34,7 @@ struct _GisPagePrivate
 
 	guint complete : 1;
 	guint skippable : 1;
+	guint locale_dirty : 1;
 
 	GisPageManager *manager;
 };
@@ -99,10 +100,10 @@ gis_page_set_property (GObject      *object,
 			gis_page_set_title (page, (char *) g_value_get_string (value));
 		break;
 		case PROP_COMPLETE:
-			priv->complete = g_value_get_boolean (value);
+			gis_page_set_complete (page, g_value_get_boolean (value));
 		break;
 		case PROP_SKIPPABLE:
-			priv->skippable = g_value_get_boolean (value);
+			gis_page_set_skippable (page, g_value_get_boolean (value));
 		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -182,6 +183,9 @@ gis_page_set_title (GisPage *page, char *title)
 {
 	GisPagePrivate *priv = page->priv;
 
+	if (g_strcmp0 (priv->title, title) == 0)
+		return;
+
 	g_clear_pointer (&priv->title, g_free);
 	priv->title = g_strdup (title);
 
@@ -194,9 +198,16 @@ gis_page_get_complete (GisPage *page)
 	return page->priv->complete;
 }
 
+/* Like the other setters, only notifies when the value changes, so
+ * pages can call it whenever they recheck their state */
 void
 gis_page_set_complete (GisPage *page, gboolean complete)
 {
+	complete = !!complete;
+
+	if (page->priv->complete == complete)
+		return;
+
 	page->priv->complete = complete;
 
 	g_object_notify_by_pspec (G_OBJECT (page), obj_props[PROP_COMPLETE]);
@@ -211,6 +222,11 @@ gis_page_get_skippable (GisPage *page)
 void
 gis_page_set_skippable (GisPage *page, gboolean skippable)
 {
+	skippable = !!skippable;
+
+	if (page->priv->skippable == skippable)
+		return;
+
 	page->priv->skippable = skippable;
 
 	g_object_notify_by_pspec (G_OBJECT (page), obj_props[PROP_SKIPPABLE]);
@@ -251,6 +267,29 @@ gis_page_save_data (GisPage *page)
 void
 gis_page_locale_changed (GisPage *page)
 {
+	page->priv->locale_dirty = FALSE;
+
 	if (GIS_PAGE_GET_CLASS (page)->locale_changed)
 		GIS_PAGE_GET_CLASS (page)->locale_changed (page);
 }
+
+/* Marks the page as needing a relabel without touching its widgets;
+ * the relabel happens on the next gis_page_flush_locale_changed (). */
+void
+gis_page_queue_locale_changed (GisPage *page)
+{
+	page->priv->locale_dirty = TRUE;
+}
+
+gboolean
+gis_page_get_locale_dirty (GisPage *page)
+{
+	return page->priv->locale_dirty;
+}
+
+void
+gis_page_flush_locale_changed (GisPage *page)
+{
+	if (page->priv->locale_dirty)
+		gis_page_locale_changed (page);
+}
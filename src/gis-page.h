@@ -81,6 +81,9 @@ gboolean     gis_page_is_done          (GisPage  *page,
 
 void         gis_page_save_data        (GisPage *page);
 void         gis_page_locale_changed   (GisPage *page);
+void         gis_page_queue_locale_changed (GisPage *page);
+void         gis_page_flush_locale_changed (GisPage *page);
+gboolean     gis_page_get_locale_dirty (GisPage *page);
 
 G_END_DECLS
 
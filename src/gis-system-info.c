@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Facts about the installed system that pages show but never change:
+ * the OS name from /etc/os-release, the hostname and the default locale
+ * from /etc/default/locale. The files are read asynchronously once when
+ * the object is created and again whenever they change on disk, so the
+ * getters never touch the file system. "changed" is emitted once all of
+ * them have been read and whenever a value changes after that.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "gis-system-info.h"
+
+
+typedef enum {
+	SYSTEM_FILE_OS_RELEASE,
+	SYSTEM_FILE_HOSTNAME,
+	SYSTEM_FILE_LOCALE,
+	N_SYSTEM_FILES
+} SystemFile;
+
+static const gchar *system_files[N_SYSTEM_FILES] = {
+	"/etc/os-release",
+	"/etc/hostname",
+	"/etc/default/locale"
+};
+
+#define ALL_FILES_LOADED ((1 << N_SYSTEM_FILES) - 1)
+
+enum {
+	CHANGED,
+	LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+
+struct _GisSystemInfoPrivate {
+	gchar        *values[N_SYSTEM_FILES];
+	GFileMonitor *monitors[N_SYSTEM_FILES];
+
+	guint loaded;           /* one bit per file read at least once */
+
+	GCancellable *cancellable;
+};
+
+typedef struct {
+	GisSystemInfo *info;
+	SystemFile     file;
+} LoadData;
+
+G_DEFINE_TYPE_WITH_PRIVATE (GisSystemInfo, gis_system_info, G_TYPE_OBJECT)
+
+
+static gboolean
+is_valid_key (const gchar *key)
+{
+	const gchar *p;
+
+	if (!g_ascii_isalpha (*key) && *key != '_')
+		return FALSE;
+
+	for (p = key; *p; p++) {
+		if (!g_ascii_isalnum (*p) && *p != '_')
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Parses the KEY=VALUE format shared by os-release(5) and
+ * /etc/default/locale. Blank lines and comments are skipped, values may
+ * be quoted the way the shell does it. Later assignments win.
+ */
+GHashTable *
+gis_system_info_parse_env_file (const gchar *contents,
+                                gsize        length)
+{
+	guint i;
+	gchar *text;
+	gchar **lines;
+	GHashTable *table;
+
+	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	text = g_strndup (contents, length);
+	lines = g_strsplit (text, "\n", -1);
+	g_free (text);
+
+	for (i = 0; lines[i] != NULL; i++) {
+		gchar *line, *sep, *value;
+
+		line = g_strstrip (lines[i]);
+		if (*line == '\0' || *line == '#')
+			continue;
+
+		if (g_str_has_prefix (line, "export "))
+			line = g_strchug (line + strlen ("export "));
+
+		sep = strchr (line, '=');
+		if (sep == NULL)
+			continue;
+
+		*sep = '\0';
+		g_strchomp (line);
+		if (!is_valid_key (line))
+			continue;
+
+		value = g_shell_unquote (g_strchug (sep + 1), NULL);
+		if (value == NULL)
+			value = g_strdup (sep + 1);
+
+		g_hash_table_replace (table, g_strdup (line), value);
+	}
+
+	g_strfreev (lines);
+
+	return table;
+}
+
+/* hostname(5): the first line that is not a comment */
+static gchar *
+parse_hostname (const gchar *contents,
+                gsize        length)
+{
+	guint i;
+	gchar *text, *hostname = NULL;
+	gchar **lines;
+
+	text = g_strndup (contents, length);
+	lines = g_strsplit (text, "\n", -1);
+	g_free (text);
+
+	for (i = 0; lines[i] != NULL && hostname == NULL; i++) {
+		gchar *line = g_strstrip (lines[i]);
+
+		if (*line != '\0' && *line != '#')
+			hostname = g_strdup (line);
+	}
+
+	g_strfreev (lines);
+
+	return hostname;
+}
+
+static gchar *
+parse_value (SystemFile   file,
+             const gchar *contents,
+             gsize        length)
+{
+	gchar *value = NULL;
+	GHashTable *table;
+
+	switch (file)
+	{
+		case SYSTEM_FILE_OS_RELEASE:
+			table = gis_system_info_parse_env_file (contents, length);
+			value = g_strdup (g_hash_table_lookup (table, "NAME"));
+			g_hash_table_destroy (table);
+		break;
+
+		case SYSTEM_FILE_HOSTNAME:
+			value = parse_hostname (contents, length);
+		break;
+
+		case SYSTEM_FILE_LOCALE:
+			table = gis_system_info_parse_env_file (contents, length);
+			value = g_strdup (g_hash_table_lookup (table, "LANG"));
+			g_hash_table_destroy (table);
+		break;
+
+		default:
+			g_assert_not_reached ();
+	}
+
+	if (value && *value == '\0')
+		g_clear_pointer (&value, g_free);
+
+	return value;
+}
+
+/* Takes @value */
+static void
+set_value (GisSystemInfo *info,
+           SystemFile     file,
+           gchar         *value)
+{
+	gboolean changed, was_ready;
+	GisSystemInfoPrivate *priv = info->priv;
+
+	was_ready = (priv->loaded == ALL_FILES_LOADED);
+	changed = (g_strcmp0 (priv->values[file], value) != 0);
+
+	g_free (priv->values[file]);
+	priv->values[file] = value;
+	priv->loaded |= (1 << file);
+
+	if (priv->loaded != ALL_FILES_LOADED)
+		return;
+
+	if (!was_ready || changed)
+		g_signal_emit (info, signals[CHANGED], 0);
+}
+
+static void
+file_loaded_cb (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+	gsize length = 0;
+	gchar *contents = NULL;
+	GError *error = NULL;
+	LoadData *data = user_data;
+
+	if (!g_file_load_contents_finish (G_FILE (source_object), res,
+                                      &contents, &length, NULL, &error)) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			/* the object is gone */
+			g_error_free (error);
+			g_free (data);
+			return;
+		}
+
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+			g_warning ("Failed to read %s: %s", system_files[data->file], error->message);
+
+		g_error_free (error);
+	}
+
+	set_value (data->info, data->file,
+               contents ? parse_value (data->file, contents, length) : NULL);
+
+	g_free (contents);
+	g_free (data);
+}
+
+static void
+load_file (GisSystemInfo *info,
+           SystemFile     file)
+{
+	GFile *gfile;
+	LoadData *data;
+
+	data = g_new0 (LoadData, 1);
+	data->info = info;
+	data->file = file;
+
+	gfile = g_file_new_for_path (system_files[file]);
+	g_file_load_contents_async (gfile, info->priv->cancellable, file_loaded_cb, data);
+	g_object_unref (gfile);
+}
+
+static void
+file_changed_cb (GFileMonitor      *monitor,
+                 GFile             *file,
+                 GFile             *other_file,
+                 GFileMonitorEvent  event_type,
+                 gpointer           user_data)
+{
+	guint i;
+	GisSystemInfo *info = GIS_SYSTEM_INFO (user_data);
+
+	/* a plain CHANGED is followed by CHANGES_DONE_HINT */
+	if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+        event_type != G_FILE_MONITOR_EVENT_CREATED &&
+        event_type != G_FILE_MONITOR_EVENT_DELETED)
+		return;
+
+	for (i = 0; i < N_SYSTEM_FILES; i++) {
+		if (info->priv->monitors[i] == monitor) {
+			g_debug ("%s changed, reading it again", system_files[i]);
+			load_file (info, i);
+			break;
+		}
+	}
+}
+
+static void
+gis_system_info_dispose (GObject *object)
+{
+	guint i;
+	GisSystemInfoPrivate *priv = GIS_SYSTEM_INFO (object)->priv;
+
+	if (priv->cancellable) {
+		g_cancellable_cancel (priv->cancellable);
+		g_clear_object (&priv->cancellable);
+	}
+
+	for (i = 0; i < N_SYSTEM_FILES; i++) {
+		if (priv->monitors[i]) {
+			g_signal_handlers_disconnect_by_func (priv->monitors[i], file_changed_cb, object);
+			g_file_monitor_cancel (priv->monitors[i]);
+			g_clear_object (&priv->monitors[i]);
+		}
+	}
+
+	G_OBJECT_CLASS (gis_system_info_parent_class)->dispose (object);
+}
+
+static void
+gis_system_info_finalize (GObject *object)
+{
+	guint i;
+	GisSystemInfoPrivate *priv = GIS_SYSTEM_INFO (object)->priv;
+
+	for (i = 0; i < N_SYSTEM_FILES; i++)
+		g_free (priv->values[i]);
+
+	G_OBJECT_CLASS (gis_system_info_parent_class)->finalize (object);
+}
+
+static void
+gis_system_info_init (GisSystemInfo *info)
+{
+	guint i;
+	GisSystemInfoPrivate *priv;
+
+	priv = info->priv = gis_system_info_get_instance_private (info);
+
+	priv->cancellable = g_cancellable_new ();
+
+	for (i = 0; i < N_SYSTEM_FILES; i++) {
+		GFile *file;
+		GError *error = NULL;
+
+		file = g_file_new_for_path (system_files[i]);
+		priv->monitors[i] = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
+		if (priv->monitors[i]) {
+			g_signal_connect (priv->monitors[i], "changed",
+                              G_CALLBACK (file_changed_cb), info);
+		} else {
+			g_warning ("Failed to watch %s: %s", system_files[i], error->message);
+			g_error_free (error);
+		}
+		g_object_unref (file);
+
+		load_file (info, i);
+	}
+}
+
+static void
+gis_system_info_class_init (GisSystemInfoClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->dispose = gis_system_info_dispose;
+	object_class->finalize = gis_system_info_finalize;
+
+    signals[CHANGED] = g_signal_new ("changed",
+                                     GIS_TYPE_SYSTEM_INFO,
+                                     G_SIGNAL_RUN_FIRST,
+                                     G_STRUCT_OFFSET (GisSystemInfoClass, changed),
+                                     NULL, NULL,
+                                     g_cclosure_marshal_VOID__VOID,
+                                     G_TYPE_NONE, 0);
+}
+
+GisSystemInfo *
+gis_system_info_new (void)
+{
+	return g_object_new (GIS_TYPE_SYSTEM_INFO, NULL);
+}
+
+/* FALSE until every file has been read once; the getters return NULL
+ * until then */
+gboolean
+gis_system_info_is_ready (GisSystemInfo *info)
+{
+	g_return_val_if_fail (GIS_IS_SYSTEM_INFO (info), FALSE);
+
+	return (info->priv->loaded == ALL_FILES_LOADED);
+}
+
+/* NAME from /etc/os-release, or NULL */
+const gchar *
+gis_system_info_get_os_name (GisSystemInfo *info)
+{
+	g_return_val_if_fail (GIS_IS_SYSTEM_INFO (info), NULL);
+
+	return info->priv->values[SYSTEM_FILE_OS_RELEASE];
+}
+
+const gchar *
+gis_system_info_get_hostname (GisSystemInfo *info)
+{
+	g_return_val_if_fail (GIS_IS_SYSTEM_INFO (info), NULL);
+
+	return info->priv->values[SYSTEM_FILE_HOSTNAME];
+}
+
+/* LANG from /etc/default/locale, or NULL */
+const gchar *
+gis_system_info_get_default_locale (GisSystemInfo *info)
+{
+	g_return_val_if_fail (GIS_IS_SYSTEM_INFO (info), NULL);
+
+	return info->priv->values[SYSTEM_FILE_LOCALE];
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GIS_SYSTEM_INFO_H__
+#define __GIS_SYSTEM_INFO_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GIS_TYPE_SYSTEM_INFO         (gis_system_info_get_type ())
+#define GIS_SYSTEM_INFO(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), GIS_TYPE_SYSTEM_INFO, GisSystemInfo))
+#define GIS_SYSTEM_INFO_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST((k), GIS_TYPE_SYSTEM_INFO, GisSystemInfoClass))
+#define GIS_IS_SYSTEM_INFO(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), GIS_TYPE_SYSTEM_INFO))
+#define GIS_IS_SYSTEM_INFO_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), GIS_TYPE_SYSTEM_INFO))
+#define GIS_SYSTEM_INFO_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), GIS_TYPE_SYSTEM_INFO, GisSystemInfoClass))
+
+typedef struct _GisSystemInfo        GisSystemInfo;
+typedef struct _GisSystemInfoClass   GisSystemInfoClass;
+typedef struct _GisSystemInfoPrivate GisSystemInfoPrivate;
+
+struct _GisSystemInfo
+{
+	GObject          __parent__;
+
+	GisSystemInfoPrivate *priv;
+};
+
+struct _GisSystemInfoClass
+{
+	GObjectClass __parent_class__;
+
+	void (*changed) (GisSystemInfo *info);
+};
+
+
+GType          gis_system_info_get_type           (void);
+
+GisSystemInfo *gis_system_info_new                (void);
+
+gboolean       gis_system_info_is_ready           (GisSystemInfo *info);
+
+const gchar   *gis_system_info_get_os_name        (GisSystemInfo *info);
+const gchar   *gis_system_info_get_hostname       (GisSystemInfo *info);
+const gchar   *gis_system_info_get_default_locale (GisSystemInfo *info);
+
+GHashTable    *gis_system_info_parse_env_file     (const gchar   *contents,
+                                                   gsize          length);
+
+
+G_END_DECLS
+
+#endif /* __GIS_SYSTEM_INFO_H__ */
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Measures how long each template in the resource bundle takes to
+ * inflate, that is to look up in the bundle and to turn into widgets
+ * with GtkBuilder. Run it with "make bench-templates"; it needs a display.
+ *
+ * The page classes are not linked in, so a template is built as a plain
+ * object of its parent class, and classes GtkBuilder does not know are
+ * replaced with GtkBox. The numbers therefore cover parsing and building
+ * the widget tree, not the page's own init code.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#define RESOURCE_ROOT "/kr/gooroom/initial-setup/"
+#define FALLBACK_CLASS "GtkBox"
+
+static gint iterations = 100;
+
+static GOptionEntry option_entries[] =
+{
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Number of times each template is built", "N" },
+    { NULL }
+};
+
+
+static void
+collect_templates (const gchar  *path,
+                   GPtrArray    *templates)
+{
+	guint i;
+	gchar **children;
+
+	children = g_resources_enumerate_children (path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+	if (children == NULL)
+		return;
+
+	for (i = 0; children[i] != NULL; i++) {
+		gchar *child = g_strconcat (path, children[i], NULL);
+
+		if (g_str_has_suffix (child, "/")) {
+			collect_templates (child, templates);
+			g_free (child);
+		} else if (g_str_has_suffix (child, ".ui")) {
+			g_ptr_array_add (templates, child);
+		} else {
+			g_free (child);
+		}
+	}
+
+	g_strfreev (children);
+}
+
+static const gchar *
+known_class (GtkBuilder  *builder,
+             const gchar *name)
+{
+	if (name && gtk_builder_get_type_from_name (builder, name) != G_TYPE_INVALID)
+		return name;
+
+	return FALLBACK_CLASS;
+}
+
+static gboolean
+rewrite_element_cb (const GMatchInfo *info,
+                    GString          *result,
+                    gpointer          user_data)
+{
+	gchar *element, *class, *parent;
+	GtkBuilder *builder = GTK_BUILDER (user_data);
+
+	element = g_match_info_fetch (info, 1);
+	class = g_match_info_fetch (info, 2);
+	parent = g_match_info_fetch (info, 4);
+
+	if (g_str_equal (element, "template"))
+		g_string_append_printf (result, "<object class=\"%s\" id=\"template\"",
+                                known_class (builder, parent));
+	else
+		g_string_append_printf (result, "<object class=\"%s\"",
+                                known_class (builder, class));
+
+	g_free (element);
+	g_free (class);
+	g_free (parent);
+
+	return FALSE;
+}
+
+/* Turns the <template> into an <object> GtkBuilder can build on its own */
+static gchar *
+template_to_object (GtkBuilder  *builder,
+                    const gchar *markup)
+{
+	gchar *tmp, *result;
+	GRegex *element, *closing;
+
+	element = g_regex_new ("<(template|object) class=\"([^\"]+)\"( parent=\"([^\"]+)\")?",
+                           0, 0, NULL);
+	closing = g_regex_new ("</template>", 0, 0, NULL);
+
+	tmp = g_regex_replace_eval (element, markup, -1, 0, 0, rewrite_element_cb, builder, NULL);
+	result = g_regex_replace_literal (closing, tmp, -1, 0, "</object>", 0, NULL);
+
+	g_free (tmp);
+	g_regex_unref (element);
+	g_regex_unref (closing);
+
+	return result;
+}
+
+static gboolean
+build_once (const gchar  *markup,
+            GError      **error)
+{
+	GSList *objects, *l;
+	GtkBuilder *builder;
+
+	builder = gtk_builder_new ();
+
+	if (!gtk_builder_add_from_string (builder, markup, -1, error)) {
+		g_object_unref (builder);
+		return FALSE;
+	}
+
+	/* toplevels are owned by GTK, not by the builder */
+	objects = gtk_builder_get_objects (builder);
+	for (l = objects; l; l = l->next) {
+		if (GTK_IS_WINDOW (l->data))
+			gtk_widget_destroy (GTK_WIDGET (l->data));
+	}
+	g_slist_free (objects);
+
+	g_object_unref (builder);
+
+	return TRUE;
+}
+
+static void
+bench_template (const gchar *path)
+{
+	gint i;
+	gint64 start, lookup, total = 0, best = G_MAXINT64;
+	gchar *markup;
+	GBytes *bytes;
+	GError *error = NULL;
+	GtkBuilder *builder;
+
+	start = g_get_monotonic_time ();
+	bytes = g_resources_lookup_data (path, G_RESOURCE_LOOKUP_FLAGS_NONE, &error);
+	lookup = g_get_monotonic_time () - start;
+
+	if (bytes == NULL) {
+		g_warning ("Failed to look up %s: %s", path, error->message);
+		g_error_free (error);
+		return;
+	}
+
+	builder = gtk_builder_new ();
+	markup = template_to_object (builder, g_bytes_get_data (bytes, NULL));
+	g_object_unref (builder);
+
+	for (i = 0; i < iterations; i++) {
+		gint64 elapsed;
+
+		start = g_get_monotonic_time ();
+		if (!build_once (markup, &error)) {
+			g_warning ("Failed to build %s: %s", path, error->message);
+			g_error_free (error);
+			goto out;
+		}
+		elapsed = g_get_monotonic_time () - start;
+
+		total += elapsed;
+		best = MIN (best, elapsed);
+	}
+
+	printf ("%-60s %8" G_GSIZE_FORMAT " %10.3f %10.3f %10.3f\n",
+            path + strlen (RESOURCE_ROOT),
+            g_bytes_get_size (bytes),
+            lookup / 1000.0,
+            best / 1000.0,
+            (gdouble) total / iterations / 1000.0);
+
+out:
+	g_free (markup);
+	g_bytes_unref (bytes);
+}
+
+int
+main (int argc, char **argv)
+{
+	guint i;
+	GError *error = NULL;
+	GPtrArray *templates;
+
+	if (!gtk_init_with_args (&argc, &argv, NULL, option_entries, NULL, &error)) {
+		g_warning ("%s", error ? error->message : "Cannot open display");
+		g_clear_error (&error);
+		return 1;
+	}
+
+	if (iterations < 1)
+		iterations = 1;
+
+	templates = g_ptr_array_new_with_free_func (g_free);
+	collect_templates (RESOURCE_ROOT, templates);
+
+	printf ("%-60s %8s %10s %10s %10s\n", "template", "bytes", "lookup ms", "min ms", "mean ms");
+
+	for (i = 0; i < templates->len; i++)
+		bench_template (g_ptr_array_index (templates, i));
+
+	g_ptr_array_unref (templates);
+
+	return 0;
+}
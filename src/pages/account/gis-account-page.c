@@ -30,7 +30,6 @@
 #include <gio/gio.h>
 #include <gtk/gtk.h>
 
-#include "account-resources.h"
 #include "gis-account-page.h"
 #include "um-utils.h"
 #include "pw-utils.h"
@@ -346,6 +345,16 @@ gis_account_page_pre_next (GisPage *page)
 	return TRUE;
 }
 
+static gboolean
+gis_account_page_should_show (GisPage *page)
+{
+	GisPageManager *manager = page->manager;
+
+	/* the user info has already been applied from the preseed */
+	return !(gis_page_manager_has_preseed (manager, "Account", "UserName") &&
+             gis_page_manager_has_preseed (manager, "Account", "Password"));
+}
+
 static void
 gis_account_page_init (GisAccountPage *page)
 {
@@ -359,8 +368,6 @@ gis_account_page_init (GisAccountPage *page)
 	priv->realname_entry_text = NULL;
 	priv->validation_timeout_id = 0;
 
-	g_resources_register (account_get_resource ());
-
 	gtk_widget_init_template (GTK_WIDGET (page));
 
 	gis_page_set_title (GIS_PAGE (page), _("Creating Accounts"));
@@ -389,6 +396,7 @@ gis_account_page_class_init (GisAccountPageClass *klass)
 	page_class->pre_next = gis_account_page_pre_next;
 	page_class->locale_changed = gis_account_page_locale_changed;
 	page_class->shown = gis_account_page_shown;
+	page_class->should_show = gis_account_page_should_show;
 
 	object_class->constructed = gis_account_page_constructed;
 	object_class->finalize = gis_account_page_finalize;
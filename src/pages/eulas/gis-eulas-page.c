@@ -23,138 +23,231 @@
 #include <config.h>
 #endif
 
-#include "eulas-resources.h"
 #include "gis-eulas-page.h"
 #include "utils.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <gtk/gtk.h>
 
-typedef enum {
-	TEXT,
-	MARKUP,
-	SKIP,
-} FileType;
+/* bytes of agreement text inserted per main loop iteration */
+#define FILL_CHUNK_SIZE (16 * 1024)
 
 struct _GisEulasPagePrivate {
 	GtkWidget *checkbox;
 	GtkWidget *scrolled_window;
 	GtkWidget *text_view;
 
-	GFile *eulas;
+	GResource *bundle;
+
+	/* resource path and version of the agreement for the current locale */
+	gchar *eulas;
+	gchar *eulas_checksum;
+
+	/* agreement path -> fully built GtkTextBuffer */
+	GHashTable *buffers;
+
+	GCancellable *cancellable;
+	EulaBufferFill *fill;
+	gchar *fill_path;
+	guint fill_id;
 
 	gboolean require_checkbox;
 };
 
+/* owned by the loading thread, which must not touch the page */
+typedef struct {
+	GResource *bundle;
+	gchar     *path;
+} LoadData;
+
 G_DEFINE_TYPE_WITH_PRIVATE (GisEulasPage, gis_eulas_page, GIS_TYPE_PAGE);
 
 
-static FileType
-get_file_type (GFile *file)
+static void
+stop_loading (GisEulasPage *page)
 {
-	gchar *path, *last_dot;
-	FileType type;
-
-	path = g_file_get_path (file);
-	last_dot = strrchr (path, '.');
+	GisEulasPagePrivate *priv = page->priv;
 
-	if (g_strcmp0 (last_dot, ".txt") == 0)
-		type = TEXT;
-	else if (g_strcmp0 (last_dot, ".xml") == 0)
-		type = MARKUP;
-	else
-		type = SKIP;
+	if (priv->cancellable) {
+		g_cancellable_cancel (priv->cancellable);
+		g_clear_object (&priv->cancellable);
+	}
 
-	g_free (path);
+	if (priv->fill_id > 0) {
+		g_source_remove (priv->fill_id);
+		priv->fill_id = 0;
+	}
 
-	return type;
+	g_clear_pointer (&priv->fill, eula_buffer_fill_free);
+	g_clear_pointer (&priv->fill_path, g_free);
 }
 
 static gboolean
-build_eulas_text_buffer (GFile          *file,
-                         GtkTextBuffer **buffer_out,
-                         GError        **error_out)
+fill_buffer_idle (gpointer user_data)
 {
-	GtkTextBuffer *buffer = NULL;
-	GtkTextIter start, end;
+	GisEulasPage *page = GIS_EULAS_PAGE (user_data);
+	GisEulasPagePrivate *priv = page->priv;
+	GtkTextBuffer *buffer;
 	GError *error = NULL;
-	GInputStream *input_stream = NULL;
-	FileType type = get_file_type (file);
 
-	if (type == SKIP)
-		return FALSE;
+	if (!eula_buffer_fill_step (priv->fill, FILL_CHUNK_SIZE, &error))
+		return G_SOURCE_CONTINUE;
 
-	input_stream = G_INPUT_STREAM (g_file_read (file, NULL, &error));
-	if (input_stream == NULL)
-		goto error_out;
+	if (error) {
+		/* keep what could be read, but try again on the next show */
+		g_warning ("Error while reading EULAS: %s", error->message);
+		g_error_free (error);
+		g_clear_pointer (&priv->fill_path, g_free);
+	} else {
+		buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->text_view));
+		g_hash_table_insert (priv->buffers, priv->fill_path, g_object_ref (buffer));
+		priv->fill_path = NULL;
+	}
+
+	g_clear_pointer (&priv->fill, eula_buffer_fill_free);
+	priv->fill_id = 0;
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+load_data_free (gpointer user_data)
+{
+	LoadData *data = user_data;
+
+	g_resource_unref (data->bundle);
+	g_free (data->path);
+	g_free (data);
+}
 
+static void
+load_document_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+	LoadData *data = task_data;
+	GError *error = NULL;
+	EulaDocument *document;
+
+	document = eula_document_load (data->bundle, data->path, &error);
+	if (document)
+		g_task_return_pointer (task, document, (GDestroyNotify) eula_document_free);
+	else
+		g_task_return_error (task, error);
+}
+
+static void
+load_document_done_cb (GObject      *source_object,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+	GisEulasPage *page;
+	GisEulasPagePrivate *priv;
+	GtkTextBuffer *buffer;
+	EulaDocument *document;
+	GError *error = NULL;
+
+	document = g_task_propagate_pointer (G_TASK (res), &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
+	}
+
+	page = GIS_EULAS_PAGE (source_object);
+	priv = page->priv;
+
+	g_clear_object (&priv->cancellable);
+
+	if (document == NULL) {
+		g_warning ("Error while reading EULAS: %s", error->message);
+		g_error_free (error);
+		g_clear_pointer (&priv->fill_path, g_free);
+		return;
+	}
+
+	/* the view shows the buffer while it is being filled */
 	buffer = gtk_text_buffer_new (NULL);
+	gtk_text_view_set_buffer (GTK_TEXT_VIEW (priv->text_view), buffer);
+
+	priv->fill = eula_buffer_fill_new (document, buffer);
+	priv->fill_id = g_idle_add (fill_buffer_idle, page);
+
+	g_object_unref (buffer);
+}
+
+static void
+load_eulas (GisEulasPage *page)
+{
+	gchar *path;
+	GtkTextBuffer *buffer;
+	GTask *task;
+	LoadData *data;
+	GisEulasPagePrivate *priv = page->priv;
+
+	if (priv->eulas == NULL)
+		return;
+
+	path = g_strdup (priv->eulas);
 
-	switch (type)
-	{
-		case TEXT:
-			if (!splice_buffer_text (input_stream, buffer, &error))
-				goto error_out;
-
-			/* monospace the text */
-			gtk_text_buffer_create_tag (buffer, "monospace", "family", "monospace", NULL);
-			gtk_text_buffer_get_start_iter (buffer, &start);
-			gtk_text_buffer_get_end_iter (buffer, &end);
-			gtk_text_buffer_apply_tag_by_name (buffer, "monospace", &start, &end);
-		break;
-
-		case MARKUP:
-			if (!splice_buffer_markup (input_stream, buffer, &error))
-				goto error_out;
-		break;
-
-		default:
-		break;
+	/* already being loaded */
+	if (g_strcmp0 (path, priv->fill_path) == 0) {
+		g_free (path);
+		return;
 	}
 
-	*buffer_out = buffer;
+	stop_loading (page);
 
-	return TRUE;
+	buffer = g_hash_table_lookup (priv->buffers, path);
+	if (buffer) {
+		gtk_text_view_set_buffer (GTK_TEXT_VIEW (priv->text_view), buffer);
+		g_free (path);
+		return;
+	}
 
-error_out:
-	g_propagate_error (error_out, error);
+	priv->fill_path = path;
+	priv->cancellable = g_cancellable_new ();
 
-	if (buffer != NULL)
-		g_object_unref (buffer);
+	data = g_new0 (LoadData, 1);
+	data->bundle = g_resource_ref (priv->bundle);
+	data->path = g_strdup (path);
 
-	return FALSE;
+	task = g_task_new (page, priv->cancellable, load_document_done_cb, NULL);
+	g_task_set_task_data (task, data, load_data_free);
+	g_task_set_return_on_cancel (task, TRUE);
+	g_task_run_in_thread (task, load_document_thread);
+	g_object_unref (task);
 }
 
-static gchar *
-get_language (GisEulasPage *page)
+static void
+update_eulas (GisEulasPage *page)
 {
-	gchar *lang = NULL;
+	GisEulasPagePrivate *priv = page->priv;
 	GisPageManager *manager = GIS_PAGE (page)->manager;
 
-	lang = gis_page_manager_get_language (manager);
+	g_clear_pointer (&priv->eulas, g_free);
+	g_clear_pointer (&priv->eulas_checksum, g_free);
 
-	if (!lang)
-		lang = g_getenv ("LANG") ? g_strdup (g_getenv ("LANG")) : NULL;
+	if (priv->bundle == NULL)
+		return;
 
-	if (!lang) {
-		gsize len, i;
-		gchar *buffer = NULL;
-		if (g_file_get_contents ("/etc/default/locale", &buffer, &len, NULL)) {
-			for (i = 0; i < len; i++) {
-				if (buffer[i] == '\n')
-					buffer[i] = '\0';
-			}
-			gchar **items = g_strsplit (buffer, "=", -1);
-			if (items && g_strv_length (items) > 1)
-				lang = g_strdup (items[1]);
+	priv->eulas = eula_bundle_lookup (priv->bundle,
+                                      gis_page_manager_get_locale (manager),
+                                      &priv->eulas_checksum);
+}
 
-			g_strfreev (items);
-		}
-		g_free (buffer);
-	}
+static gboolean
+is_preseed_accepted (GisEulasPage *page)
+{
+	GisPageManager *manager = GIS_PAGE (page)->manager;
 
-	return lang;
+	return gis_page_manager_get_preseed_boolean (manager, "Eula", "Accepted");
 }
 
 static gboolean
@@ -162,6 +255,9 @@ get_page_complete (GisEulasPage *page)
 {
 	GisEulasPagePrivate *priv = page->priv;
 
+	if (is_preseed_accepted (page))
+		return TRUE;
+
 	if (priv->require_checkbox) {
 		GtkToggleButton *checkbox = GTK_TOGGLE_BUTTON (priv->checkbox);
 		if (!gtk_toggle_button_get_active (checkbox)) {
@@ -182,12 +278,19 @@ static void
 gis_eulas_page_constructed (GObject *object)
 {
 	gboolean require_checkbox = TRUE;
+	GError *error = NULL;
 
 	GisEulasPage *self = GIS_EULAS_PAGE (object);
 	GisEulasPagePrivate *priv = self->priv;
 
 	G_OBJECT_CLASS (gis_eulas_page_parent_class)->constructed (object);
 
+	priv->bundle = g_resource_load (EULAS_BUNDLE_FILE, &error);
+	if (priv->bundle == NULL) {
+		g_warning ("Failed to load license agreements: %s", error->message);
+		g_error_free (error);
+	}
+
 	gtk_text_view_set_border_window_size (GTK_TEXT_VIEW (priv->text_view), GTK_TEXT_WINDOW_TOP, 12);
 	gtk_text_view_set_border_window_size (GTK_TEXT_VIEW (priv->text_view), GTK_TEXT_WINDOW_LEFT, 12);
 	gtk_text_view_set_border_window_size (GTK_TEXT_VIEW (priv->text_view), GTK_TEXT_WINDOW_RIGHT, 12);
@@ -218,66 +321,146 @@ gis_eulas_page_locale_changed (GisPage *page)
                           _("I have _agreed to the terms and conditions in this end user license agreement."));
 }
 
+static gboolean
+gis_eulas_page_should_show (GisPage *page)
+{
+	return !is_preseed_accepted (GIS_EULAS_PAGE (page));
+}
+
 static void
 gis_eulas_page_shown (GisPage *page)
 {
-	const gchar *eulas_name;
-	gchar *eulas_dir_path, *lang;
 	GisEulasPage *self = GIS_EULAS_PAGE (page);
-	GisEulasPagePrivate *priv = self->priv;
 
-	lang = get_language (self);
-	if (g_str_equal (lang, "ko_KR.UTF-8")) {
-		eulas_name = "user_agreements_ko.txt";
-	} else {
-		eulas_name = "user_agreements_en.txt";
-	}
+	update_eulas (self);
 
-	eulas_dir_path = g_build_filename (PKGDATADIR, "eulas", eulas_name, NULL);
-	priv->eulas = g_file_new_for_path (eulas_dir_path);
-	g_free (eulas_dir_path);
+	load_eulas (self);
+}
 
-	if (g_file_query_exists (priv->eulas, NULL)) {
-		GError *error = NULL;
-		GtkTextBuffer *buffer;
+/* Writes @contents to a temporary file next to @filename, syncs it once
+ * and renames it into place, so the file is either complete or absent. */
+static gboolean
+write_file_synced (const gchar  *filename,
+                   const gchar  *contents,
+                   gsize         length,
+                   GError      **error)
+{
+	gint fd;
+	gchar *tmp_name;
+	gboolean ret = FALSE;
 
-		if (!build_eulas_text_buffer (priv->eulas, &buffer, &error)) {
-			if (error) {
-				g_warning ("Error while reading EULAS: %s", error->message);
-				g_clear_error (&error);
-			}
+	tmp_name = g_strdup_printf ("%s.XXXXXX", filename);
+
+	fd = g_mkstemp_full (tmp_name, O_WRONLY, 0644);
+	if (fd < 0) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to create %s: %s", tmp_name, g_strerror (errno));
+		goto out;
+	}
+
+	while (length > 0) {
+		gssize written = write (fd, contents, length);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                         "Failed to write %s: %s", tmp_name, g_strerror (errno));
+			close (fd);
+			g_unlink (tmp_name);
+			goto out;
 		}
+		contents += written;
+		length -= written;
+	}
 
-		gtk_text_view_set_buffer (GTK_TEXT_VIEW (priv->text_view), buffer);
+	if (fsync (fd) != 0 || close (fd) != 0) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to sync %s: %s", tmp_name, g_strerror (errno));
+		g_unlink (tmp_name);
+		goto out;
+	}
+
+	if (g_rename (tmp_name, filename) != 0) {
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Failed to rename %s: %s", tmp_name, g_strerror (errno));
+		g_unlink (tmp_name);
+		goto out;
 	}
+
+	ret = TRUE;
+
+out:
+	g_free (tmp_name);
+
+	return ret;
 }
 
+/*
+ * Instead of a copy of the agreement, only a record of its acceptance is
+ * kept; the text itself stays in the installed bundle:
+ *
+ *   [Agreement]
+ *   Bundle=/usr/share/gooroom-initial-setup/eulas/eulas.gresource
+ *   Id=/kr/gooroom/initial-setup/eulas/ko/user_agreements.txt
+ *   Checksum=<sha256 of the agreement>
+ *   Language=ko_KR.UTF-8
+ *   User=gooroom
+ *   AcceptedAt=2020-01-01T00:00:00Z
+ *   Preseeded=false
+ */
 static void
 gis_eulas_page_save_data (GisPage *page)
 {
 	GisEulasPage *self = GIS_EULAS_PAGE (page);
 	GisEulasPagePrivate *priv = self->priv;
+	GKeyFile *keyfile;
+	GDateTime *now;
+	gchar *username = NULL;
+	const gchar *dest_dir;
+	gchar *timestamp, *data, *dest_path;
+	gsize length;
+	GError *error = NULL;
 
-	if (priv->eulas) {
-		if (g_file_query_exists (priv->eulas, NULL)) {
-			GFile *dest = NULL;
-			gchar *dest_path = NULL;
-			GError *error = NULL;
-
-			dest_path = g_build_filename (g_get_user_config_dir (), "user_agreements", NULL);
-			dest = g_file_new_for_path (dest_path);
-			if (!g_file_copy (priv->eulas, dest, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error)) {
-				if (error) {
-					g_warning ("Failed to copy user_agreements: %s", error->message);
-					g_error_free (error);
-				} else {
-					g_warning ("Failed to copy user_agreements");
-				}
-			}
-			g_free (dest_path);
-			g_object_unref (dest);
-		}
+	/* the page is never shown when the agreement is preseeded */
+	if (!priv->eulas)
+		update_eulas (self);
+
+	if (!priv->eulas)
+		return;
+
+	gis_page_manager_get_user_info (page->manager, NULL, &username, NULL);
+
+	now = g_date_time_new_now_utc ();
+	timestamp = g_date_time_format (now, "%Y-%m-%dT%H:%M:%SZ");
+	g_date_time_unref (now);
+
+	keyfile = g_key_file_new ();
+	g_key_file_set_string (keyfile, "Agreement", "Bundle", EULAS_BUNDLE_FILE);
+	g_key_file_set_string (keyfile, "Agreement", "Id", priv->eulas);
+	g_key_file_set_string (keyfile, "Agreement", "Checksum",
+                           priv->eulas_checksum ? priv->eulas_checksum : "");
+	g_key_file_set_string (keyfile, "Agreement", "Language",
+                           gis_page_manager_get_locale (page->manager));
+	g_key_file_set_string (keyfile, "Agreement", "User", username ? username : "");
+	g_key_file_set_string (keyfile, "Agreement", "AcceptedAt", timestamp);
+	g_key_file_set_boolean (keyfile, "Agreement", "Preseeded", is_preseed_accepted (self));
+
+	data = g_key_file_to_data (keyfile, &length, NULL);
+
+	dest_dir = g_get_user_config_dir ();
+	dest_path = g_build_filename (dest_dir, "user_agreements", NULL);
+	g_mkdir_with_parents (dest_dir, 0700);
+
+	if (!write_file_synced (dest_path, data, length, &error)) {
+		g_warning ("Failed to save the agreement record: %s", error->message);
+		g_error_free (error);
 	}
+
+	g_free (dest_path);
+	g_free (data);
+	g_free (timestamp);
+	g_free (username);
+	g_key_file_free (keyfile);
 }
 
 static void
@@ -285,7 +468,12 @@ gis_eulas_page_dispose (GObject *object)
 {
 	GisEulasPage *self = GIS_EULAS_PAGE (object);
 
-	g_clear_object (&self->priv->eulas);
+	stop_loading (self);
+
+	g_clear_pointer (&self->priv->eulas, g_free);
+	g_clear_pointer (&self->priv->eulas_checksum, g_free);
+	g_clear_pointer (&self->priv->buffers, g_hash_table_destroy);
+	g_clear_pointer (&self->priv->bundle, g_resource_unref);
 
 	G_OBJECT_CLASS (gis_eulas_page_parent_class)->dispose (object);
 }
@@ -297,7 +485,7 @@ gis_eulas_page_init (GisEulasPage *page)
   
 	priv = page->priv = gis_eulas_page_get_instance_private (page);
 
-	g_resources_register (eulas_get_resource ());
+	priv->buffers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
 
 	gtk_widget_init_template (GTK_WIDGET (page));
 
@@ -320,6 +508,7 @@ gis_eulas_page_class_init (GisEulasPageClass *klass)
 	page_class->shown = gis_eulas_page_shown;
 	page_class->save_data = gis_eulas_page_save_data;
 	page_class->locale_changed = gis_eulas_page_locale_changed;
+	page_class->should_show = gis_eulas_page_should_show;
 
 	object_class->constructed = gis_eulas_page_constructed;
 	object_class->dispose = gis_eulas_page_dispose;
@@ -22,9 +22,31 @@
 
 #include "utils.h"
 
+#include <string.h>
 #include <gtk/gtk.h>
 #include <pango/pango.h>
 
+#define EULA_BUNDLE_PREFIX "/kr/gooroom/initial-setup/eulas"
+
+struct _EulaDocument {
+  gboolean markup;
+  GBytes *bytes;
+  const gchar *text;
+  gsize length;
+};
+
+struct _EulaBufferFill {
+  EulaDocument *document;
+  GtkTextBuffer *buffer;
+  GtkTextTag *para_tag;
+  gsize offset;
+
+  /* markup documents only */
+  GMarkupParseContext *context;
+  GHashTable *tags;     /* element signature -> GtkTextTag */
+  GPtrArray *stack;     /* tag of each open element, or NULL */
+};
+
 /* remove when this is landed in GTK+ itself */
 static GtkTextTag *
 text_buffer_get_text_tag_from_pango (PangoAttrIterator *paiter)
@@ -91,109 +113,338 @@ text_buffer_get_text_tag_from_pango (PangoAttrIterator *paiter)
   return tag;
 }
 
-static void
-text_buffer_insert_pango_text (GtkTextBuffer *buffer,
-                               GtkTextIter *iter,
-                               PangoAttrList *attrlist,
-                               gchar *text)
+/* Resolves @locale to an agreement in @bundle, falling back from
+ * ll_CC to ll and finally to C. Returns the resource path of the
+ * agreement, and its version checksum in @checksum if requested. */
+gchar *
+eula_bundle_lookup (GResource    *bundle,
+                    const gchar  *locale,
+                    gchar       **checksum)
 {
-  GtkTextMark *mark;
-  PangoAttrIterator *paiter;
+  static const gchar *names[] = { "user_agreements.xml", "user_agreements.txt", NULL };
+  gchar **variants;
+  gchar *path = NULL;
+  gint i, j;
 
-  g_return_if_fail (GTK_IS_TEXT_BUFFER (buffer));
+  variants = g_get_locale_variants (locale ? locale : "C");
 
-  /* trivial, no markup */
-  if (attrlist == NULL) {
-    gtk_text_buffer_insert (buffer, iter, text, -1);
-    return;
+  for (i = 0; path == NULL; i++) {
+    const gchar *variant = variants[i] ? variants[i] : "C";
+
+    for (j = 0; names[j] != NULL && path == NULL; j++) {
+      gchar *candidate = g_strdup_printf (EULA_BUNDLE_PREFIX "/%s/%s", variant, names[j]);
+
+      if (g_resource_get_info (bundle, candidate, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL, NULL, NULL))
+        path = candidate;
+      else
+        g_free (candidate);
+    }
+
+    if (path != NULL && checksum != NULL) {
+      gchar *checksum_path = g_strdup_printf (EULA_BUNDLE_PREFIX "/%s/checksum", variant);
+      GBytes *bytes = g_resource_lookup_data (bundle, checksum_path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+
+      *checksum = bytes ? g_strstrip (g_strndup (g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes))) : NULL;
+
+      if (bytes)
+        g_bytes_unref (bytes);
+      g_free (checksum_path);
+    }
+
+    if (variants[i] == NULL)
+      break;
+  }
+
+  g_strfreev (variants);
+
+  return path;
+}
+
+EulaDocument *
+eula_document_load (GResource    *bundle,
+                    const gchar  *path,
+                    GError      **error)
+{
+  const gchar *contents;
+  gsize length;
+  GBytes *bytes;
+  EulaDocument *document;
+
+  /* uncompressed resources are returned straight from the mapped bundle */
+  bytes = g_resource_lookup_data (bundle, path, G_RESOURCE_LOOKUP_FLAGS_NONE, error);
+  if (bytes == NULL)
+    return NULL;
+
+  contents = g_bytes_get_data (bytes, &length);
+  if (contents == NULL)
+    contents = "";
+
+  if (!g_utf8_validate (contents, length, NULL)) {
+    g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                 "%s is not valid UTF-8", path);
+    g_bytes_unref (bytes);
+    return NULL;
   }
 
-  /* create mark with right gravity */
-  mark = gtk_text_buffer_create_mark (buffer, NULL, iter, FALSE);
-  paiter = pango_attr_list_get_iterator (attrlist);
+  document = g_new0 (EulaDocument, 1);
+  document->markup = g_str_has_suffix (path, ".xml");
+  document->bytes = bytes;
+  document->text = contents;
+  document->length = length;
+
+  return document;
+}
+
+void
+eula_document_free (EulaDocument *document)
+{
+  if (document == NULL)
+    return;
 
-  do {
-    GtkTextTag *tag;
-    GtkTextTag *tag_para;
-    gint start, end;
+  g_bytes_unref (document->bytes);
+  g_free (document);
+}
 
-    pango_attr_iterator_range (paiter, &start, &end);
+static gchar *
+element_signature (const gchar  *element_name,
+                   const gchar **attribute_names,
+                   const gchar **attribute_values)
+{
+  GString *signature = g_string_new (element_name);
+  gint i;
 
-    if (end == G_MAXINT)	/* last chunk */
-      end = start-1; /* resulting in -1 to be passed to _insert */
+  for (i = 0; attribute_names[i] != NULL; i++) {
+    gchar *value = g_markup_escape_text (attribute_values[i], -1);
+    g_string_append_printf (signature, " %s=\"%s\"", attribute_names[i], value);
+    g_free (value);
+  }
 
-    tag = text_buffer_get_text_tag_from_pango (paiter);
+  return g_string_free (signature, FALSE);
+}
 
-    gtk_text_tag_table_add (gtk_text_buffer_get_tag_table (buffer), tag);
+/* Let Pango interpret the element once and turn the result into a tag;
+ * every later element with the same signature reuses that tag. */
+static GtkTextTag *
+intern_element_tag (EulaBufferFill  *fill,
+                    const gchar     *signature,
+                    const gchar     *element_name,
+                    GError         **error)
+{
+  GtkTextTag *tag;
+  gchar *snippet;
+  PangoAttrList *attrs = NULL;
+  PangoAttrIterator *paiter;
 
-    tag_para = gtk_text_tag_table_lookup (gtk_text_buffer_get_tag_table (buffer), "para");
-    gtk_text_buffer_insert_with_tags (buffer, iter, text+start, end - start, tag, tag_para, NULL);
+  if (g_hash_table_lookup_extended (fill->tags, signature, NULL, (gpointer *) &tag))
+    return tag;
 
-    /* mark had right gravity, so it should be
-     *	at the end of the inserted text now */
-    gtk_text_buffer_get_iter_at_mark (buffer, iter, mark);
-  } while (pango_attr_iterator_next (paiter));
+  snippet = g_strdup_printf ("<%s>x</%s>", signature, element_name);
+  if (!pango_parse_markup (snippet, -1, 0, &attrs, NULL, NULL, error)) {
+    g_free (snippet);
+    return NULL;
+  }
+  g_free (snippet);
 
-  gtk_text_buffer_delete_mark (buffer, mark);
+  paiter = pango_attr_list_get_iterator (attrs);
+  tag = text_buffer_get_text_tag_from_pango (paiter);
   pango_attr_iterator_destroy (paiter);
+  pango_attr_list_unref (attrs);
+
+  gtk_text_tag_table_add (gtk_text_buffer_get_tag_table (fill->buffer), tag);
+  g_hash_table_insert (fill->tags, g_strdup (signature), tag);
+
+  return tag;
 }
 
-/* lifted from g_output_stream_splice */
-gboolean
-splice_buffer_text (GInputStream  *stream,
-                    GtkTextBuffer *buffer,
-                    GError       **error)
+static void
+markup_start_element (GMarkupParseContext  *context,
+                      const gchar          *element_name,
+                      const gchar         **attribute_names,
+                      const gchar         **attribute_values,
+                      gpointer              user_data,
+                      GError              **error)
 {
-  char contents[8192];
-  gssize n_read;
-  GtkTextIter iter;
+  EulaBufferFill *fill = user_data;
+  GtkTextTag *tag = NULL;
+  gchar *signature;
 
-  while (TRUE) {
-    n_read = g_input_stream_read (stream, contents, sizeof (contents), NULL, error);
+  if (strcmp (element_name, "markup") != 0) {
+    signature = element_signature (element_name, attribute_names, attribute_values);
+    tag = intern_element_tag (fill, signature, element_name, error);
+    g_free (signature);
 
-    /* error or eof */
-    if (n_read <= 0)
-      break;
+    if (tag == NULL)
+      return;
+  }
+
+  g_ptr_array_add (fill->stack, tag);
+}
+
+static void
+markup_end_element (GMarkupParseContext  *context,
+                    const gchar          *element_name,
+                    gpointer              user_data,
+                    GError              **error)
+{
+  EulaBufferFill *fill = user_data;
+
+  if (fill->stack->len > 0)
+    g_ptr_array_remove_index (fill->stack, fill->stack->len - 1);
+}
+
+static void
+markup_text (GMarkupParseContext  *context,
+             const gchar          *text,
+             gsize                 text_len,
+             gpointer              user_data,
+             GError              **error)
+{
+  EulaBufferFill *fill = user_data;
+  GtkTextIter start, end;
+  gint offset;
+  guint i;
+
+  if (text_len == 0)
+    return;
+
+  gtk_text_buffer_get_end_iter (fill->buffer, &end);
+  offset = gtk_text_iter_get_offset (&end);
 
-    gtk_text_buffer_get_end_iter (buffer, &iter);
-    gtk_text_buffer_insert (buffer, &iter, contents, n_read);
+  if (fill->stack->len == 0) {
+    gtk_text_buffer_insert_with_tags (fill->buffer, &end, text, text_len, fill->para_tag, NULL);
+    return;
   }
 
-  return (*error == NULL);
+  gtk_text_buffer_insert (fill->buffer, &end, text, text_len);
+  gtk_text_buffer_get_iter_at_offset (fill->buffer, &start, offset);
+
+  if (fill->para_tag)
+    gtk_text_buffer_apply_tag (fill->buffer, fill->para_tag, &start, &end);
+
+  for (i = 0; i < fill->stack->len; i++) {
+    GtkTextTag *tag = g_ptr_array_index (fill->stack, i);
+    if (tag)
+      gtk_text_buffer_apply_tag (fill->buffer, tag, &start, &end);
+  }
 }
 
+static const GMarkupParser markup_parser = {
+  markup_start_element,
+  markup_end_element,
+  markup_text,
+  NULL,
+  NULL
+};
+
+/* Takes ownership of @document. */
+EulaBufferFill *
+eula_buffer_fill_new (EulaDocument  *document,
+                      GtkTextBuffer *buffer)
+{
+  GtkTextTagTable *table;
+  EulaBufferFill *fill;
+
+  fill = g_new0 (EulaBufferFill, 1);
+  fill->document = document;
+  fill->buffer = g_object_ref (buffer);
+
+  table = gtk_text_buffer_get_tag_table (buffer);
+
+  if (document->markup) {
+    fill->para_tag = gtk_text_tag_table_lookup (table, "para");
+    fill->tags = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+    fill->stack = g_ptr_array_new ();
+    fill->context = g_markup_parse_context_new (&markup_parser, 0, fill, NULL);
+
+    /* like Pango, accept text outside of a single root element */
+    g_markup_parse_context_parse (fill->context, "<markup>", -1, NULL);
+  } else {
+    /* monospace the text */
+    fill->para_tag = gtk_text_tag_table_lookup (table, "monospace");
+    if (fill->para_tag == NULL)
+      fill->para_tag = gtk_text_buffer_create_tag (buffer, "monospace", "family", "monospace", NULL);
+  }
+
+  return fill;
+}
+
+static gboolean
+eula_buffer_fill_step_markup (EulaBufferFill  *fill,
+                              gsize            max_bytes,
+                              GError         **error)
+{
+  EulaDocument *document = fill->document;
+  gsize len = MIN (max_bytes, document->length - fill->offset);
+
+  /* the parser inserts as it goes, so only @max_bytes of markup are
+   * parsed and inserted per step */
+  if (!g_markup_parse_context_parse (fill->context, document->text + fill->offset, len, error))
+    return TRUE;
+
+  fill->offset += len;
+
+  if (fill->offset < document->length)
+    return FALSE;
+
+  if (g_markup_parse_context_parse (fill->context, "</markup>", -1, error))
+    g_markup_parse_context_end_parse (fill->context, error);
+
+  return TRUE;
+}
+
+/* Appends at most @max_bytes of the document to the buffer; returns TRUE
+ * once the whole document has been inserted or parsing failed. */
 gboolean
-splice_buffer_markup (GInputStream  *stream,
-                      GtkTextBuffer *buffer,
-                      GError       **error)
+eula_buffer_fill_step (EulaBufferFill  *fill,
+                       gsize            max_bytes,
+                       GError         **error)
 {
-  char contents[8192];
-  gssize n_read;
+  EulaDocument *document = fill->document;
   GtkTextIter iter;
-  GMarkupParseContext *context;
-  PangoAttrList *attr_list;
-  gchar *text;
+  gsize chunk_end;
 
-  context = pango_markup_parser_new (0);
+  if (document->markup)
+    return eula_buffer_fill_step_markup (fill, max_bytes, error);
 
-  while (TRUE) {
-    n_read = g_input_stream_read (stream, contents, sizeof (contents), NULL, error);
+  if (fill->offset >= document->length)
+    return TRUE;
 
-    /* error or eof */
-    if (n_read <= 0)
-      break;
+  chunk_end = MIN (document->length, fill->offset + max_bytes);
 
-    if (!g_markup_parse_context_parse (context, contents, n_read, error))
-      goto out;
+  /* never split a character between two inserts */
+  if (chunk_end < document->length) {
+    const gchar *p = g_utf8_find_prev_char (document->text + fill->offset,
+                                            document->text + chunk_end + 1);
+    if (p != NULL && p > document->text + fill->offset)
+      chunk_end = p - document->text;
+    else
+      chunk_end = g_utf8_next_char (document->text + fill->offset) - document->text;
   }
 
-  if (!pango_markup_parser_finish (context, &attr_list, &text, NULL, error))
-    goto out;
+  gtk_text_buffer_get_end_iter (fill->buffer, &iter);
+  gtk_text_buffer_insert_with_tags (fill->buffer, &iter,
+                                    document->text + fill->offset,
+                                    chunk_end - fill->offset,
+                                    fill->para_tag, NULL);
+
+  fill->offset = chunk_end;
 
-  gtk_text_buffer_get_end_iter (buffer, &iter);
-  text_buffer_insert_pango_text (buffer, &iter, attr_list, text);
+  return (fill->offset >= document->length);
+}
+
+void
+eula_buffer_fill_free (EulaBufferFill *fill)
+{
+  if (fill == NULL)
+    return;
 
- out:
-  g_markup_parse_context_free (context);
-  return (*error == NULL);
+  if (fill->context)
+    g_markup_parse_context_free (fill->context);
+  if (fill->stack)
+    g_ptr_array_unref (fill->stack);
+  if (fill->tags)
+    g_hash_table_destroy (fill->tags);
+  g_object_unref (fill->buffer);
+  eula_document_free (fill->document);
+  g_free (fill);
 }
@@ -24,13 +24,24 @@
 
 G_BEGIN_DECLS
 
-gboolean splice_buffer_text (GInputStream  *stream,
-                             GtkTextBuffer *buffer,
-                             GError       **error);
-
-gboolean splice_buffer_markup (GInputStream  *stream,
-                               GtkTextBuffer *buffer,
-                               GError       **error);
+typedef struct _EulaDocument   EulaDocument;
+typedef struct _EulaBufferFill EulaBufferFill;
+
+gchar          *eula_bundle_lookup    (GResource      *bundle,
+                                       const gchar    *locale,
+                                       gchar         **checksum);
+
+EulaDocument   *eula_document_load    (GResource      *bundle,
+                                       const gchar    *path,
+                                       GError        **error);
+void            eula_document_free    (EulaDocument   *document);
+
+EulaBufferFill *eula_buffer_fill_new  (EulaDocument   *document,
+                                       GtkTextBuffer  *buffer);
+gboolean        eula_buffer_fill_step (EulaBufferFill *fill,
+                                       gsize           max_bytes,
+                                       GError        **error);
+void            eula_buffer_fill_free (EulaBufferFill *fill);
 
 G_END_DECLS
 
@@ -24,7 +24,7 @@
 #endif
 
 #include "gis-goa-page.h"
-#include "goa-resources.h"
+#include "gis-image.h"
 
 #define GOA_API_IS_SUBJECT_TO_CHANGE
 #include <goa/goa.h>
@@ -33,7 +33,9 @@
 
 #include <gio/gio.h>
 #include <glib/gi18n-lib.h>
-#include <libsecret/secret.h>
+
+/* offered when the provider catalog does not say otherwise */
+static const gchar *default_providers[] = { "google", "owncloud", "windows_live", NULL };
 
 
 struct _GisGoaPagePrivate {
@@ -45,8 +47,14 @@ struct _GisGoaPagePrivate {
 	GtkWidget *error_image;
 
 	GoaClient *goa_client;
+	GCancellable *cancellable;
+	gboolean backend_started;
+
 	GHashTable *providers;
-	gboolean accounts_exist;
+	GKeyFile *catalog;
+
+	/* account id -> GoaAccount, for the accounts of listed providers */
+	GHashTable *accounts;
 };
 
 
@@ -55,9 +63,10 @@ G_DEFINE_TYPE_WITH_PRIVATE (GisGoaPage, gis_goa_page, GIS_TYPE_PAGE);
 struct _ProviderWidget {
 	GisGoaPage *page;
 	GoaProvider *provider;
-	GoaAccount *displayed_account;
+	GoaAccount *displayed_account; /* owned by the accounts index */
 
 	GtkWidget *row;
+	GtkWidget *image;
 	GtkWidget *checkmark;
 	GtkWidget *label;
 	GtkWidget *account_label;
@@ -80,32 +89,6 @@ sync_provider_widget (ProviderWidget *provider_widget)
                                   goa_account_get_presentation_identity (provider_widget->displayed_account));
 		gtk_label_set_markup (GTK_LABEL (provider_widget->account_label), markup);
 		g_free (markup);
-
-		const gchar *id;
-		gchar *password = NULL;
-		gchar *password_key = NULL;
-
-		static const SecretSchema secret_password_schema =
-		{
-			"org.gnome.OnlineAccounts", SECRET_SCHEMA_DONT_MATCH_NAME,
-			{
-				{ "goa-identity", SECRET_SCHEMA_ATTRIBUTE_STRING },
-				{ "NULL", 0 }
-			}
-		};
-
-		id = goa_account_get_id (provider_widget->displayed_account);
-
-		password_key = g_strdup_printf ("%s:gen%d:%s",
-				goa_provider_get_provider_type (provider_widget->provider),
-				goa_provider_get_credentials_generation (provider_widget->provider),
-				id);
-
-		password = secret_password_lookup_sync (&secret_password_schema,
-				NULL,
-				NULL,
-				"goa-identity", password_key,
-				NULL);
 	}
 }
 
@@ -144,6 +127,57 @@ out:
 	gtk_widget_destroy (dialog);
 }
 
+static gint
+get_provider_icon_size (void)
+{
+	gint width = 48, height = 48;
+
+	gtk_icon_size_lookup (GTK_ICON_SIZE_DIALOG, &width, &height);
+
+	return MAX (width, height);
+}
+
+static void
+provider_icon_loaded_cb (GObject      *source_object,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+	ProviderWidget *provider_widget = user_data;
+
+	pixbuf = gtk_icon_info_load_icon_finish (GTK_ICON_INFO (source_object), res, &error);
+	if (pixbuf == NULL) {
+		/* the page, and provider_widget with it, may be gone */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Failed to load provider icon: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	gtk_image_set_from_pixbuf (GTK_IMAGE (provider_widget->image), pixbuf);
+	g_object_unref (pixbuf);
+}
+
+static void
+prefetch_provider_icon (ProviderWidget *provider_widget,
+                        GIcon          *icon)
+{
+	GtkIconInfo *info;
+	GisGoaPagePrivate *priv = provider_widget->page->priv;
+
+	info = gtk_icon_theme_lookup_by_gicon (gtk_icon_theme_get_default (), icon,
+                                           get_provider_icon_size (),
+                                           GTK_ICON_LOOKUP_FORCE_SIZE);
+	if (info == NULL) {
+		gtk_image_set_from_gicon (GTK_IMAGE (provider_widget->image), icon, GTK_ICON_SIZE_DIALOG);
+		return;
+	}
+
+	gtk_icon_info_load_icon_async (info, priv->cancellable, provider_icon_loaded_cb, provider_widget);
+	g_object_unref (info);
+}
+
 static void
 add_provider_to_list (GisGoaPage *page, const char *provider_type)
 {
@@ -168,9 +202,9 @@ add_provider_to_list (GisGoaPage *page, const char *provider_type)
 	g_object_set (box, "margin", 4, NULL);
 	gtk_widget_set_hexpand (box, TRUE);
 
-	icon = goa_provider_get_provider_icon (provider, NULL);
-	image = gtk_image_new_from_gicon (icon, GTK_ICON_SIZE_DIALOG);
-	g_object_unref (icon);
+	/* the icon is filled in once it has been loaded in the background */
+	image = gtk_image_new ();
+	gtk_image_set_pixel_size (GTK_IMAGE (image), get_provider_icon_size ());
 
 	provider_name = goa_provider_get_provider_name (provider, NULL);
 	markup = g_strdup_printf ("<b>%s</b>", provider_name);
@@ -199,64 +233,306 @@ add_provider_to_list (GisGoaPage *page, const char *provider_type)
 	provider_widget->page = page;
 	provider_widget->provider = provider;
 	provider_widget->row = row;
+	provider_widget->image = image;
 	provider_widget->checkmark = checkmark;
 	provider_widget->label = label;
 	provider_widget->account_label = account_label;
 
 	g_object_set_data (G_OBJECT (row), "widget", provider_widget);
 
-	g_hash_table_insert (priv->providers, (char *) provider_type, provider_widget);
+	g_hash_table_insert (priv->providers, g_strdup (provider_type), provider_widget);
 
 	gtk_container_add (GTK_CONTAINER (priv->accounts_list), row);
+
+	icon = goa_provider_get_provider_icon (provider, NULL);
+	prefetch_provider_icon (provider_widget, icon);
+	g_object_unref (icon);
 }
 
+/*
+ * The catalog is a key file; every key is optional:
+ *
+ *   [Providers]
+ *   Order=owncloud;google     providers offered, in this order
+ *
+ *   [Provider owncloud]
+ *   Enabled=false             never offer it
+ *
+ * Providers that are not offered are never looked up, so their backend
+ * code is not loaded. There are no per-site defaults such as a server
+ * address: goa_provider_add_account() has no way to pass them in.
+ */
 static void
 populate_provider_list (GisGoaPage *page)
 {
-	add_provider_to_list (page, "google");
-	add_provider_to_list (page, "owncloud");
-	add_provider_to_list (page, "windows_live");
+	guint i;
+	gchar **order;
+	GisGoaPagePrivate *priv = page->priv;
+
+	order = g_key_file_get_string_list (priv->catalog, "Providers", "Order", NULL, NULL);
+	if (order == NULL)
+		order = g_strdupv ((gchar **) default_providers);
+
+	for (i = 0; order[i] != NULL; i++) {
+		gchar *group;
+		GError *error = NULL;
+		gboolean enabled;
+
+		if (g_hash_table_contains (priv->providers, order[i]))
+			continue;
+
+		group = g_strdup_printf ("Provider %s", order[i]);
+
+		enabled = g_key_file_get_boolean (priv->catalog, group, "Enabled", &error);
+		if (error) {
+			enabled = TRUE;
+			g_error_free (error);
+		}
+
+		if (enabled)
+			add_provider_to_list (page, order[i]);
+
+		g_free (group);
+	}
+
+	g_strfreev (order);
+}
+
+static void
+load_provider_catalog (GisGoaPage *page)
+{
+	GError *error = NULL;
+	GisGoaPagePrivate *priv = page->priv;
+
+	priv->catalog = g_key_file_new ();
+
+	if (!g_key_file_load_from_file (priv->catalog, GOA_PROVIDERS_FILE, G_KEY_FILE_NONE, &error)) {
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_warning ("Failed to load %s: %s", GOA_PROVIDERS_FILE, error->message);
+		g_error_free (error);
+	}
+}
+
+static void
+set_displayed_account (ProviderWidget *provider_widget,
+                       GoaAccount     *account)
+{
+	gboolean had_account = (provider_widget->displayed_account != NULL);
+	GisPageManager *manager = GIS_PAGE (provider_widget->page)->manager;
+
+	provider_widget->displayed_account = account;
+
+	if (had_account != (account != NULL)) {
+		const gchar *provider_type = goa_provider_get_provider_type (provider_widget->provider);
+
+		if (account) {
+			gchar *provider_name = goa_provider_get_provider_name (provider_widget->provider, NULL);
+			gis_page_manager_add_online_account (manager, provider_type, provider_name);
+			g_free (provider_name);
+		} else {
+			gis_page_manager_remove_online_account (manager, provider_type);
+		}
+	}
+
+	sync_provider_widget (provider_widget);
+}
+
+static void
+sync_page_complete (GisGoaPage *page)
+{
+	gboolean accounts_exist = (g_hash_table_size (page->priv->accounts) > 0);
+
+	gis_page_set_skippable (GIS_PAGE (page), !accounts_exist);
+	gis_page_set_complete (GIS_PAGE (page), accounts_exist);
 }
 
 static void
-sync_accounts (GisGoaPage *page)
+index_account (GisGoaPage *page,
+               GoaAccount *account)
 {
-	GList *accounts = NULL, *l = NULL, *online_accounts = NULL;
+	GoaAccount *old_account;
+	ProviderWidget *provider_widget;
 	GisGoaPagePrivate *priv = page->priv;
+	const char *id = goa_account_get_id (account);
 
-	accounts = goa_client_get_accounts (priv->goa_client);
+	provider_widget = g_hash_table_lookup (priv->providers, goa_account_get_provider_type (account));
+	if (!provider_widget)
+		return;
 
-	for (l = accounts; l != NULL; l = l->next) {
-		GoaObject *object = GOA_OBJECT (l->data);
-		GoaAccount *account = goa_object_get_account (object);
-		const char *account_type = goa_account_get_provider_type (account);
-		ProviderWidget *provider_widget;
+	old_account = g_hash_table_lookup (priv->accounts, id);
+	if (old_account == account)
+		return;
 
-		provider_widget = g_hash_table_lookup (priv->providers, account_type);
-		if (!provider_widget)
-			continue;
+	g_hash_table_replace (priv->accounts, g_strdup (id), g_object_ref (account));
 
-		priv->accounts_exist = TRUE;
+	if (provider_widget->displayed_account == NULL || provider_widget->displayed_account == old_account)
+		set_displayed_account (provider_widget, account);
+}
 
-		if (provider_widget->displayed_account)
-			continue;
+static void
+account_added_cb (GoaClient *client,
+                  GoaObject *object,
+                  gpointer   user_data)
+{
+	GisGoaPage *page = GIS_GOA_PAGE (user_data);
+	GoaAccount *account = goa_object_peek_account (object);
+
+	if (account)
+		index_account (page, account);
+
+	sync_page_complete (page);
+}
+
+static void
+account_changed_cb (GoaClient *client,
+                    GoaObject *object,
+                    gpointer   user_data)
+{
+	GoaAccount *account;
+	ProviderWidget *provider_widget;
+	GisGoaPage *page = GIS_GOA_PAGE (user_data);
+	GisGoaPagePrivate *priv = page->priv;
+
+	account = goa_object_peek_account (object);
+	if (!account)
+		return;
+
+	if (!g_hash_table_contains (priv->accounts, goa_account_get_id (account))) {
+		index_account (page, account);
+		sync_page_complete (page);
+		return;
+	}
 
-		provider_widget->displayed_account = account;
+	provider_widget = g_hash_table_lookup (priv->providers, goa_account_get_provider_type (account));
+	if (provider_widget && provider_widget->displayed_account == account)
 		sync_provider_widget (provider_widget);
+}
+
+static void
+account_removed_cb (GoaClient *client,
+                    GoaObject *object,
+                    gpointer   user_data)
+{
+	const char *id;
+	GoaAccount *account, *replacement = NULL;
+	ProviderWidget *provider_widget;
+	GHashTableIter iter;
+	GisGoaPage *page = GIS_GOA_PAGE (user_data);
+	GisGoaPagePrivate *priv = page->priv;
+
+	account = goa_object_peek_account (object);
+	if (!account)
+		return;
+
+	id = goa_account_get_id (account);
+	account = g_hash_table_lookup (priv->accounts, id);
+	if (!account)
+		return;
+
+	provider_widget = g_hash_table_lookup (priv->providers, goa_account_get_provider_type (account));
+
+	/* show another account of the same provider, if there is one */
+	if (provider_widget && provider_widget->displayed_account == account) {
+		GoaAccount *candidate;
+
+		g_hash_table_iter_init (&iter, priv->accounts);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer) &candidate)) {
+			if (candidate != account &&
+                g_strcmp0 (goa_account_get_provider_type (candidate),
+                           goa_account_get_provider_type (account)) == 0) {
+				replacement = candidate;
+				break;
+			}
+		}
+
+		set_displayed_account (provider_widget, replacement);
+	}
+
+	g_hash_table_remove (priv->accounts, id);
+
+	sync_page_complete (page);
+}
+
+static void
+index_all_accounts (GisGoaPage *page)
+{
+	GList *accounts = NULL, *l = NULL;
+	GisGoaPagePrivate *priv = page->priv;
+
+	accounts = goa_client_get_accounts (priv->goa_client);
+
+	for (l = accounts; l != NULL; l = l->next) {
+		GoaAccount *account = goa_object_peek_account (GOA_OBJECT (l->data));
+		if (account)
+			index_account (page, account);
 	}
 
 	g_list_free_full (accounts, (GDestroyNotify) g_object_unref);
 
-	gis_page_set_skippable (GIS_PAGE (page), !priv->accounts_exist);
-	gis_page_set_complete (GIS_PAGE (page), priv->accounts_exist);
+	sync_page_complete (page);
 }
 
 static void
-accounts_changed (GoaClient *client, GoaObject *object, gpointer user_data)
+goa_client_ready_cb (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
 {
-	GisGoaPage *page = GIS_GOA_PAGE (user_data);
+	GoaClient *client;
+	GisGoaPage *page;
+	GisGoaPagePrivate *priv;
+	GError *error = NULL;
+
+	client = goa_client_new_finish (res, &error);
+	if (client == NULL) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_error_free (error);
+			return;
+		}
+
+		page = GIS_GOA_PAGE (user_data);
+		priv = page->priv;
+
+		g_warning ("Failed to get a GoaClient: %s", error->message);
+		g_error_free (error);
+		gtk_label_set_text (GTK_LABEL (priv->error_label), "Internal Error");
+
+		gtk_widget_show_all (GTK_WIDGET (priv->error_box));
+		gtk_widget_hide (GTK_WIDGET (priv->accounts_list_box));
+		return;
+	}
+
+	page = GIS_GOA_PAGE (user_data);
+	priv = page->priv;
+
+	priv->goa_client = client;
+
+	g_signal_connect (priv->goa_client, "account-added",
+                      G_CALLBACK (account_added_cb), page);
+	g_signal_connect (priv->goa_client, "account-changed",
+                      G_CALLBACK (account_changed_cb), page);
+	g_signal_connect (priv->goa_client, "account-removed",
+                      G_CALLBACK (account_removed_cb), page);
 
-	sync_accounts (page);
+	/* the only full enumeration; later changes arrive as signals */
+	index_all_accounts (page);
+}
+
+/* Nothing on this page is usable without a network, so the GOA
+ * backend is only started once one comes up. By the time the page
+ * is first shown the provider rows and their icons are ready. */
+static void
+start_backend (GisGoaPage *page)
+{
+	GisGoaPagePrivate *priv = page->priv;
+
+	if (priv->backend_started)
+		return;
+
+	priv->backend_started = TRUE;
+
+	populate_provider_list (page);
+
+	goa_client_new (priv->cancellable, goa_client_ready_cb, page);
 }
 
 static void
@@ -272,6 +548,8 @@ network_available_changed_cb (GObject    *gobject,
 	network_available = gis_page_manager_get_network_available (manager);
 
 	if (network_available) {
+		start_backend (page);
+
 		gtk_label_set_text (GTK_LABEL (priv->error_label), _("The system's network is inactive"));
 
 		gtk_widget_hide (GTK_WIDGET (priv->error_box));
@@ -307,6 +585,10 @@ row_activated (GtkListBox    *box,
 	if (row == NULL)
 		return;
 
+	/* accounts can only be added once the backend is up */
+	if (page->priv->goa_client == NULL)
+		return;
+
 	provider_widget = g_object_get_data (G_OBJECT (row), "widget");
 	g_assert (provider_widget != NULL);
 	g_assert (provider_widget->displayed_account == NULL);
@@ -324,6 +606,8 @@ foreach_metadata_free (gpointer key,
 	g_object_unref (provider_widget->provider);
 
 	g_free (provider_widget);
+
+	return TRUE;
 }
 
 static void
@@ -337,6 +621,9 @@ gis_goa_page_finalize (GObject *object)
 		g_hash_table_destroy (priv->providers);
 	}
 
+	g_hash_table_destroy (priv->accounts);
+	g_key_file_free (priv->catalog);
+
 	G_OBJECT_CLASS (gis_goa_page_parent_class)->finalize (object);
 }
 
@@ -346,31 +633,19 @@ gis_goa_page_dispose (GObject *object)
 	GisGoaPage *page = GIS_GOA_PAGE (object);
 	GisGoaPagePrivate *priv = page->priv;
 
-	g_clear_object (&priv->goa_client);
-
-	G_OBJECT_CLASS (gis_goa_page_parent_class)->dispose (object);
-}
+	if (priv->cancellable) {
+		g_cancellable_cancel (priv->cancellable);
+		g_clear_object (&priv->cancellable);
+	}
 
-static gboolean
-gis_goa_page_pre_next (GisPage *page)
-{
-    GHashTableIter iter;
-	GList *online_accounts = NULL;
-	ProviderWidget *provider_widget = NULL;
-	GisGoaPagePrivate *priv = GIS_GOA_PAGE (page)->priv;
+	if (priv->goa_client)
+		g_signal_handlers_disconnect_by_data (priv->goa_client, page);
 
-	g_hash_table_iter_init (&iter, priv->providers);
-	while (g_hash_table_iter_next (&iter, NULL, (gpointer) &provider_widget)) {
-		if (provider_widget->displayed_account) {
-			gchar *provider_name = goa_provider_get_provider_name (provider_widget->provider, NULL);
-			online_accounts = g_list_append (online_accounts, g_strdup (provider_name));
-			g_free (provider_name);
-		}
-	}
+	g_signal_handlers_disconnect_by_data (GIS_PAGE (page)->manager, page);
 
-	gis_page_manager_set_online_accounts (page->manager, online_accounts);
+	g_clear_object (&priv->goa_client);
 
-	return TRUE;
+	G_OBJECT_CLASS (gis_goa_page_parent_class)->dispose (object);
 }
 
 static void
@@ -407,13 +682,15 @@ gis_goa_page_should_show (GisPage *page)
 
 	should_show = gis_page_manager_get_network_available (manager);
 
+	if (gis_page_manager_get_preseed_boolean (manager, "OnlineAccounts", "Skip"))
+		should_show = FALSE;
+
 	return should_show;
 }
 
 static void
 gis_goa_page_constructed (GObject *object)
 {
-	GError *error = NULL;
 	GisGoaPage *page = GIS_GOA_PAGE (object);
 	GisGoaPagePrivate *priv = page->priv;
 
@@ -421,21 +698,7 @@ gis_goa_page_constructed (GObject *object)
 
 	gis_page_set_skippable (GIS_PAGE (page), TRUE);
 
-	priv->goa_client = goa_client_new_sync (NULL, &error);
-	if (priv->goa_client == NULL) {
-		g_warning ("Failed to get a GoaClient: %s", error->message);
-		g_error_free (error);
-		gtk_label_set_text (GTK_LABEL (priv->error_label), "Internal Error");
-
-		gtk_widget_show_all (GTK_WIDGET (priv->error_box));
-		gtk_widget_hide (GTK_WIDGET (priv->accounts_list_box));
-		return;
-	}
-
-	g_signal_connect (priv->goa_client, "account-added",
-                      G_CALLBACK (accounts_changed), page);
-	g_signal_connect (priv->goa_client, "account-removed",
-                      G_CALLBACK (accounts_changed), page);
+	load_provider_catalog (page);
 
 	g_signal_connect (GIS_PAGE (page)->manager, "notify::network-available",
                       G_CALLBACK (network_available_changed_cb), page);
@@ -443,9 +706,8 @@ gis_goa_page_constructed (GObject *object)
 	gtk_list_box_set_header_func (GTK_LIST_BOX (priv->accounts_list), update_header_func, NULL, NULL);
 	g_signal_connect (priv->accounts_list, "row-activated", G_CALLBACK (row_activated), page);
 
-	populate_provider_list (page);
-
-	sync_accounts (page);
+	if (gis_page_manager_get_network_available (GIS_PAGE (page)->manager))
+		start_backend (page);
 
 done:
 	gtk_widget_show (GTK_WIDGET (page));
@@ -458,13 +720,15 @@ gis_goa_page_init (GisGoaPage *page)
 
 	priv = page->priv = gis_goa_page_get_instance_private (page);
 
-	priv->accounts_exist = FALSE;
-	priv->providers = g_hash_table_new (g_str_hash, g_str_equal);
-
-	g_resources_register (goa_get_resource ());
+	priv->cancellable = g_cancellable_new ();
+	priv->backend_started = FALSE;
+	priv->providers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->accounts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
 
 	gtk_widget_init_template (GTK_WIDGET (page));
 
+	gis_image_set_from_name (GTK_IMAGE (priv->error_image), "error-image", 180, 90);
+
 	gis_page_set_title (GIS_PAGE (page), _("Online Accounts Settings"));
 }
 
@@ -484,7 +748,6 @@ gis_goa_page_class_init (GisGoaPageClass *klass)
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisGoaPage, error_image);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisGoaPage, error_label);
 
-	page_class->pre_next = gis_goa_page_pre_next;
 	page_class->locale_changed = gis_goa_page_locale_changed;
 	page_class->should_show  = gis_goa_page_should_show;
 
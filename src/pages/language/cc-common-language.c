@@ -22,6 +22,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <locale.h>
 
 #include <glib.h>
@@ -37,50 +38,67 @@
 
 static char *get_lang_for_user_object_path (const char *path);
 
-gboolean
-cc_common_language_has_font (const gchar *locale)
+/* How often fontconfig is asked whether its configuration or fonts changed */
+#define COVERAGE_CHECK_INTERVAL (5 * G_USEC_PER_SEC)
+
+static GHashTable *coverage_index = NULL;
+static gint64      coverage_checked = 0;
+
+static void
+coverage_index_add (GHashTable    *index,
+                    const FcChar8 *lang)
 {
-        const FcCharSet *charset;
-        FcPattern       *pattern;
-        FcObjectSet     *object_set;
-        FcFontSet       *font_set;
-        gchar           *language_code;
-        gboolean         is_displayable;
+        gchar *code, *sep;
 
-        is_displayable = FALSE;
-        pattern = NULL;
-        object_set = NULL;
-        font_set = NULL;
+        code = g_ascii_strdown ((const gchar *) lang, -1);
 
-        if (!gnome_parse_locale (locale, &language_code, NULL, NULL, NULL))
-                return FALSE;
+        /* a font covering "zh-cn" also counts for "zh", just like
+         * FcFontList would match it */
+        sep = strchr (code, '-');
+        if (sep != NULL)
+                g_hash_table_add (index, g_strndup (code, sep - code));
 
-        charset = FcLangGetCharSet ((FcChar8 *) language_code);
-        if (!charset) {
-                /* fontconfig does not know about this language */
-                is_displayable = TRUE;
-        }
-        else {
-                /* see if any fonts support rendering it */
-                pattern = FcPatternBuild (NULL, FC_LANG, FcTypeString, language_code, NULL);
+        g_hash_table_add (index, code);
+}
 
-                if (pattern == NULL)
-                        goto done;
+static GHashTable *
+coverage_index_build (void)
+{
+        int i;
+        GHashTable *index;
+        FcPattern *pattern;
+        FcObjectSet *object_set;
+        FcFontSet *font_set = NULL;
 
-                object_set = FcObjectSetCreate ();
+        index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-                if (object_set == NULL)
-                        goto done;
+        pattern = FcPatternCreate ();
+        object_set = FcObjectSetBuild (FC_LANG, NULL);
 
+        if (pattern != NULL && object_set != NULL)
                 font_set = FcFontList (NULL, pattern, object_set);
 
-                if (font_set == NULL)
-                        goto done;
+        for (i = 0; font_set != NULL && i < font_set->nfont; i++) {
+                FcLangSet *lang_set;
+                FcStrSet *langs;
+                FcStrList *list;
+                FcChar8 *lang;
+
+                if (FcPatternGetLangSet (font_set->fonts[i], FC_LANG, 0, &lang_set) != FcResultMatch)
+                        continue;
 
-                is_displayable = (font_set->nfont > 0);
+                langs = FcLangSetGetLangs (lang_set);
+                if (langs == NULL)
+                        continue;
+
+                list = FcStrListCreate (langs);
+                while ((lang = FcStrListNext (list)) != NULL)
+                        coverage_index_add (index, lang);
+
+                FcStrListDone (list);
+                FcStrSetDestroy (langs);
         }
 
- done:
         if (font_set != NULL)
                 FcFontSetDestroy (font_set);
 
@@ -90,6 +108,54 @@ cc_common_language_has_font (const gchar *locale)
         if (pattern != NULL)
                 FcPatternDestroy (pattern);
 
+        return index;
+}
+
+static GHashTable *
+coverage_index_get (void)
+{
+        gint64 now = g_get_monotonic_time ();
+
+        if (coverage_index != NULL && now - coverage_checked > COVERAGE_CHECK_INTERVAL) {
+                /* drop the index only when fontconfig's view of the
+                 * installed fonts has actually changed */
+                if (!FcConfigUptoDate (NULL)) {
+                        FcInitReinitialize ();
+                        g_clear_pointer (&coverage_index, g_hash_table_destroy);
+                }
+                coverage_checked = now;
+        }
+
+        if (coverage_index == NULL) {
+                coverage_index = coverage_index_build ();
+                coverage_checked = now;
+        }
+
+        return coverage_index;
+}
+
+gboolean
+cc_common_language_has_font (const gchar *locale)
+{
+        const FcCharSet *charset;
+        gchar           *language_code;
+        gboolean         is_displayable;
+
+        if (!gnome_parse_locale (locale, &language_code, NULL, NULL, NULL))
+                return FALSE;
+
+        charset = FcLangGetCharSet ((FcChar8 *) language_code);
+        if (!charset) {
+                /* fontconfig does not know about this language */
+                is_displayable = TRUE;
+        }
+        else {
+                /* see if any fonts support rendering it */
+                gchar *code = g_ascii_strdown (language_code, -1);
+                is_displayable = g_hash_table_contains (coverage_index_get (), code);
+                g_free (code);
+        }
+
         g_free (language_code);
 
         return is_displayable;
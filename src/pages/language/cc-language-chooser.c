@@ -25,6 +25,7 @@
 
 
 #include <locale.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 
@@ -33,16 +34,24 @@
 #define GNOME_DESKTOP_USE_UNSTABLE_API
 #include <libgnome-desktop/gnome-languages.h>
 
-#include "language-resources.h"
 #include "cc-language-chooser.h"
 #include "cc-common-language.h"
+#include "cc-locale-catalog.h"
 #include "cc-util.h"
 
 #include <glib-object.h>
 
 struct _CcLanguageChooserPrivate {
+	GtkWidget *search_entry;
 	GtkWidget *language_list;
 
+	GtkListStore *store;
+	GtkTreeModel *filter;
+
+	/* locale id -> row index + 1 in store; rows are never removed */
+	GHashTable *rows;
+
+	gchar *filter_key;
 	gchar *language;
 };
 
@@ -63,181 +72,163 @@ enum {
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
-typedef struct {
-	GtkWidget *box;
-	GtkWidget *checkmark;
+enum {
+	COLUMN_LOCALE_ID,
+	COLUMN_LANGUAGE_NAME,
+	COLUMN_COUNTRY_NAME,
+	COLUMN_SORT_KEY,
+	N_COLUMNS
+};
 
+typedef struct {
 	gchar *locale_id;
-	gchar *locale_name;
-	gchar *locale_current_name;
-	gchar *locale_untranslated_name;
+	gchar *language_name;
+	gchar *country_name;
 	gchar *sort_key;
-	gboolean is_extra;
-} LanguageWidget;
-
+} LanguageEntry;
 
 
-static LanguageWidget *
-get_language_widget (GtkWidget *widget)
-{
-	return g_object_get_data (G_OBJECT (widget), "language-widget");
-}
-
-static GtkWidget *
-padded_label_new (char *text)
-{
-	GtkWidget *widget;
-	widget = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
-	gtk_widget_set_halign (widget, GTK_ALIGN_CENTER);
-	gtk_widget_set_margin_top (widget, 10);
-	gtk_widget_set_margin_bottom (widget, 10);
-	gtk_box_pack_start (GTK_BOX (widget), gtk_label_new (text), FALSE, FALSE, 0);
-	return widget;
-}
 
 static void
-language_widget_free (gpointer data)
+language_entry_free (gpointer data)
 {
-	LanguageWidget *widget = data;
-
-	/* This is called when the box is destroyed,
-	 * so don't bother destroying the widget and
-	 * children again. */
-	g_free (widget->locale_id);
-	g_free (widget->locale_name);
-	g_free (widget->locale_current_name);
-	g_free (widget->locale_untranslated_name);
-	g_free (widget->sort_key);
-	g_free (widget);
+	LanguageEntry *entry = data;
+
+	g_free (entry->locale_id);
+	g_free (entry->language_name);
+	g_free (entry->country_name);
+	g_free (entry->sort_key);
+	g_free (entry);
 }
 
-static GtkWidget *
-language_widget_new (const char *locale_id)
+static LanguageEntry *
+language_entry_new (const char *locale_id)
 {
-	GtkWidget *label;
-	gchar *locale_name, *locale_current_name, *locale_untranslated_name;
+	gchar *locale_name;
 	gchar *language = NULL;
-	gchar *language_name;
 	gchar *country = NULL;
-	gchar *country_name = NULL;
-	LanguageWidget *widget = g_new0 (LanguageWidget, 1);
+	LanguageEntry *entry;
 
 	if (!gnome_parse_locale (locale_id, &language, &country, NULL, NULL))
 		return NULL;
 
-	language_name = gnome_get_language_from_code (language, locale_id);
-
-	if (country)
-		country_name = gnome_get_country_from_code (country, locale_id);
-
 	locale_name = gnome_get_language_from_locale (locale_id, locale_id);
-	locale_current_name = gnome_get_language_from_locale (locale_id, NULL);
-	locale_untranslated_name = gnome_get_language_from_locale (locale_id, "C");
-
-	widget->box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 10);
-	gtk_widget_set_margin_top (widget->box, 10);
-	gtk_widget_set_margin_bottom (widget->box, 10);
-	gtk_widget_set_margin_start (widget->box, 10);
-	gtk_widget_set_margin_end (widget->box, 10);
-	gtk_widget_set_halign (widget->box, GTK_ALIGN_FILL);
-
-	label = gtk_label_new (language_name);
-	gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_END);
-	gtk_label_set_max_width_chars (GTK_LABEL (label), 30);
-	gtk_label_set_xalign (GTK_LABEL (label), 0);
-	gtk_box_pack_start (GTK_BOX (widget->box), label, FALSE, FALSE, 0);
-
-	widget->checkmark = gtk_image_new_from_icon_name ("object-select-symbolic", GTK_ICON_SIZE_MENU);
-	gtk_box_pack_start (GTK_BOX (widget->box), widget->checkmark, FALSE, FALSE, 0);
-	gtk_widget_show (widget->checkmark);
-
-	if (country_name) {
-		label = gtk_label_new (country_name);
-		gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_END);
-		gtk_label_set_max_width_chars (GTK_LABEL (label), 30);
-		gtk_style_context_add_class (gtk_widget_get_style_context (label), "dim-label");
-		gtk_label_set_xalign (GTK_LABEL (label), 0);
-		gtk_widget_set_halign (label, GTK_ALIGN_END);
-		gtk_box_pack_end (GTK_BOX (widget->box), label, FALSE, FALSE, 0);
-	}
-
-	widget->locale_id = g_strdup (locale_id);
-	widget->locale_name = locale_name;
-	widget->locale_current_name = locale_current_name;
-	widget->locale_untranslated_name = locale_untranslated_name;
-	widget->sort_key = cc_util_normalize_casefold_and_unaccent (locale_name);
 
-	g_object_set_data_full (G_OBJECT (widget->box), "language-widget", widget,
-			language_widget_free);
+	entry = g_new0 (LanguageEntry, 1);
+	entry->locale_id = g_strdup (locale_id);
+	entry->language_name = gnome_get_language_from_code (language, locale_id);
+	entry->country_name = country ? gnome_get_country_from_code (country, locale_id) : NULL;
+	entry->sort_key = cc_util_normalize_casefold_and_unaccent (locale_name);
 
 	g_free (language);
-	g_free (language_name);
 	g_free (country);
-	g_free (country_name);
+	g_free (locale_name);
 
-	return widget->box;
+	return entry;
 }
 
-static void
-sync_checkmark (GtkWidget *row,
-                gpointer   user_data)
+static gint
+language_entry_compare (gconstpointer a,
+                        gconstpointer b)
 {
-	GtkWidget *child;
-	LanguageWidget *widget;
-	gchar *locale_id;
-	gboolean should_be_visible;
+	const LanguageEntry *la = *(const LanguageEntry **) a;
+	const LanguageEntry *lb = *(const LanguageEntry **) b;
 
-	child = gtk_bin_get_child (GTK_BIN (row));
-	widget = get_language_widget (child);
-
-	if (widget == NULL)
-		return;
-
-	locale_id = user_data;
-	should_be_visible = g_str_equal (widget->locale_id, locale_id);
-	gtk_widget_set_opacity (widget->checkmark, should_be_visible ? 1.0 : 0.0);
+	return g_strcmp0 (la->sort_key, lb->sort_key);
 }
 
+/* Rows must be appended in sort key order; the list is never re-sorted. */
 static void
-sync_all_checkmarks (CcLanguageChooser *chooser)
+append_language (CcLanguageChooser *chooser,
+                 const char        *locale_id,
+                 const char        *language_name,
+                 const char        *country_name,
+                 const char        *sort_key)
 {
 	CcLanguageChooserPrivate *priv = chooser->priv;
 
-	gtk_container_foreach (GTK_CONTAINER (priv->language_list), sync_checkmark, priv->language);
+	if (g_hash_table_contains (priv->rows, locale_id))
+		return;
+
+	gtk_list_store_insert_with_values (priv->store, NULL, -1,
+                                       COLUMN_LOCALE_ID, locale_id,
+                                       COLUMN_LANGUAGE_NAME, language_name,
+                                       COLUMN_COUNTRY_NAME, country_name,
+                                       COLUMN_SORT_KEY, sort_key,
+                                       -1);
+
+	g_hash_table_insert (priv->rows, g_strdup (locale_id),
+                         GUINT_TO_POINTER (g_hash_table_size (priv->rows) + 1));
 }
 
-static void
-add_one_language (CcLanguageChooser *chooser,
-                  const char        *locale_id)
+static gboolean
+add_languages_from_catalog (CcLanguageChooser *chooser)
 {
-	CcLanguageChooserPrivate *priv = chooser->priv;
-	GtkWidget *widget;
+	guint i, n_entries;
+	GError *error = NULL;
+	CcLocaleCatalog *catalog;
+
+	catalog = cc_locale_catalog_load (LOCALE_CATALOG_FILE, &error);
+	if (catalog == NULL) {
+		g_debug ("Not using the locale catalog: %s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
 
-	if (!cc_common_language_has_font (locale_id)) {
-		return;
+	/* the catalog is already ordered by sort key */
+	n_entries = cc_locale_catalog_get_n_entries (catalog);
+	for (i = 0; i < n_entries; i++) {
+		CcLocaleCatalogEntry entry;
+
+		cc_locale_catalog_get_entry (catalog, i, &entry);
+		if (!entry.displayable)
+			continue;
+
+		append_language (chooser,
+                         entry.locale_id,
+                         entry.language_name,
+                         entry.country_name,
+                         entry.sort_key);
 	}
 
-	widget = language_widget_new (locale_id);
-	if (widget)
-		gtk_container_add (GTK_CONTAINER (priv->language_list), widget);
+	cc_locale_catalog_free (catalog);
+
+	return TRUE;
 }
 
 static void
 add_languages (CcLanguageChooser  *chooser,
-               char               **locale_ids)
+               char              **locale_ids)
 {
-	CcLanguageChooserPrivate *priv = chooser->priv;
+	guint i;
+	GPtrArray *entries;
 
-	while (*locale_ids) {
-		const gchar *locale_id;
+	entries = g_ptr_array_new_with_free_func (language_entry_free);
 
-		locale_id = *locale_ids;
-		locale_ids ++;
+	for (; *locale_ids; locale_ids++) {
+		LanguageEntry *entry;
 
-		add_one_language (chooser, locale_id);
+		if (!cc_common_language_has_font (*locale_ids))
+			continue;
+
+		entry = language_entry_new (*locale_ids);
+		if (entry)
+			g_ptr_array_add (entries, entry);
 	}
 
-	gtk_widget_show_all (priv->language_list);
+	g_ptr_array_sort (entries, language_entry_compare);
+
+	for (i = 0; i < entries->len; i++) {
+		LanguageEntry *entry = g_ptr_array_index (entries, i);
+
+		append_language (chooser,
+                         entry->locale_id,
+                         entry->language_name,
+                         entry->country_name,
+                         entry->sort_key);
+	}
+
+	g_ptr_array_unref (entries);
 }
 
 static void
@@ -245,6 +236,9 @@ add_all_languages (CcLanguageChooser *chooser)
 {
 	char **locale_ids;
 
+	if (add_languages_from_catalog (chooser))
+		return;
+
 	locale_ids = gnome_get_all_locales ();
 
 	add_languages (chooser, locale_ids);
@@ -252,38 +246,46 @@ add_all_languages (CcLanguageChooser *chooser)
 	g_strfreev (locale_ids);
 }
 
-static gint
-sort_languages (GtkListBoxRow *a,
-                GtkListBoxRow *b,
-                gpointer       data)
+static void
+emit_row_changed (CcLanguageChooser *chooser,
+                  const gchar       *locale_id)
 {
-	LanguageWidget *la, *lb;
-
-	la = get_language_widget (gtk_bin_get_child (GTK_BIN (a)));
-	lb = get_language_widget (gtk_bin_get_child (GTK_BIN (b)));
+	guint index;
+	GtkTreeIter iter;
+	GtkTreePath *path;
+	CcLanguageChooserPrivate *priv = chooser->priv;
 
-	if (la == NULL)
-		return 1;
+	if (locale_id == NULL)
+		return;
 
-	if (lb == NULL)
-		return -1;
+	index = GPOINTER_TO_UINT (g_hash_table_lookup (priv->rows, locale_id));
+	if (index == 0)
+		return;
 
-	return strcmp (la->sort_key, lb->sort_key);
+	path = gtk_tree_path_new_from_indices (index - 1, -1);
+	if (gtk_tree_model_get_iter (GTK_TREE_MODEL (priv->store), &iter, path))
+		gtk_tree_model_row_changed (GTK_TREE_MODEL (priv->store), path, &iter);
+	gtk_tree_path_free (path);
 }
 
 static void
 set_locale_id (CcLanguageChooser *chooser,
                const gchar       *new_locale_id)
 {
+	gchar *old_locale_id;
 	CcLanguageChooserPrivate *priv = chooser->priv;
 
 	if (g_strcmp0 (priv->language, new_locale_id) == 0)
 		return;
 
-	g_free (priv->language);
+	old_locale_id = priv->language;
 	priv->language = g_strdup (new_locale_id);
 
-	sync_all_checkmarks (chooser);
+	/* only the previously and the newly checked rows need a redraw */
+	emit_row_changed (chooser, old_locale_id);
+	emit_row_changed (chooser, priv->language);
+
+	g_free (old_locale_id);
 
 	g_object_notify_by_pspec (G_OBJECT (chooser), obj_props[PROP_LANGUAGE]);
 }
@@ -299,49 +301,169 @@ confirm_choice (gpointer data)
 }
 
 static void
-row_activated (GtkListBox        *box,
-               GtkListBoxRow     *row,
+row_activated (GtkTreeView       *view,
+               GtkTreePath       *path,
+               GtkTreeViewColumn *column,
                CcLanguageChooser *chooser)
 {
+	GtkTreeIter iter;
+	gchar *locale_id = NULL;
 	CcLanguageChooserPrivate *priv = chooser->priv;
-	GtkWidget *child;
-	LanguageWidget *widget;
 
-	if (row == NULL)
+	if (!gtk_tree_model_get_iter (priv->filter, &iter, path))
 		return;
 
-	child = gtk_bin_get_child (GTK_BIN (row));
-	widget = get_language_widget (child);
-	if (widget == NULL)
+	gtk_tree_model_get (priv->filter, &iter, COLUMN_LOCALE_ID, &locale_id, -1);
+	if (locale_id == NULL)
 		return;
 
-	if (g_strcmp0 (priv->language, widget->locale_id) == 0)
+	if (g_strcmp0 (priv->language, locale_id) == 0)
 		g_idle_add (confirm_choice, chooser);
 	else
-		set_locale_id (chooser, widget->locale_id);
+		set_locale_id (chooser, locale_id);
+
+	g_free (locale_id);
+}
+
+static gboolean
+filter_visible_func (GtkTreeModel *model,
+                     GtkTreeIter  *iter,
+                     gpointer      user_data)
+{
+	gboolean visible;
+	gchar *sort_key = NULL;
+	CcLanguageChooser *chooser = CC_LANGUAGE_CHOOSER (user_data);
+	CcLanguageChooserPrivate *priv = chooser->priv;
+
+	if (priv->filter_key == NULL || *priv->filter_key == '\0')
+		return TRUE;
+
+	gtk_tree_model_get (model, iter, COLUMN_SORT_KEY, &sort_key, -1);
+	visible = (sort_key != NULL && strstr (sort_key, priv->filter_key) != NULL);
+	g_free (sort_key);
+
+	return visible;
 }
 
 static void
-update_header_func (GtkListBoxRow *child,
-                    GtkListBoxRow *before,
-                    gpointer       user_data)
+search_changed_cb (GtkSearchEntry    *entry,
+                   CcLanguageChooser *chooser)
 {
-	GtkWidget *header;
+	CcLanguageChooserPrivate *priv = chooser->priv;
 
-	if (before == NULL)
-		return;
+	g_free (priv->filter_key);
+	priv->filter_key = cc_util_normalize_casefold_and_unaccent (gtk_entry_get_text (GTK_ENTRY (entry)));
 
-	header = gtk_separator_new (GTK_ORIENTATION_HORIZONTAL);
-	gtk_list_box_row_set_header (child, header);
-	gtk_widget_show (header);
+	gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (priv->filter));
+}
+
+/* typing while the list has focus goes to the search entry */
+static gboolean
+list_key_press_cb (GtkWidget         *widget,
+                   GdkEvent          *event,
+                   CcLanguageChooser *chooser)
+{
+	GtkWidget *entry = chooser->priv->search_entry;
+
+	if (gtk_search_entry_handle_event (GTK_SEARCH_ENTRY (entry), event) == GDK_EVENT_STOP) {
+		gtk_widget_grab_focus (entry);
+		gtk_editable_set_position (GTK_EDITABLE (entry), -1);
+		return GDK_EVENT_STOP;
+	}
+
+	return GDK_EVENT_PROPAGATE;
+}
+
+static void
+checkmark_cell_data_func (GtkTreeViewColumn *column,
+                          GtkCellRenderer   *cell,
+                          GtkTreeModel      *model,
+                          GtkTreeIter       *iter,
+                          gpointer           user_data)
+{
+	gchar *locale_id = NULL;
+	CcLanguageChooser *chooser = CC_LANGUAGE_CHOOSER (user_data);
+
+	gtk_tree_model_get (model, iter, COLUMN_LOCALE_ID, &locale_id, -1);
+
+	g_object_set (cell, "icon-name",
+                  g_strcmp0 (locale_id, chooser->priv->language) == 0 ? "object-select-symbolic" : NULL,
+                  NULL);
+
+	g_free (locale_id);
+}
+
+static GtkTreeViewColumn *
+text_column_new (gint column_id, gboolean dim)
+{
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *column;
+
+	renderer = gtk_cell_renderer_text_new ();
+	g_object_set (renderer,
+                  "ellipsize", PANGO_ELLIPSIZE_END,
+                  "xpad", 10,
+                  "ypad", 10,
+                  NULL);
+
+	if (dim) {
+		g_object_set (renderer, "xalign", 1.0, "foreground", "#555555", NULL);
+	}
+
+	column = gtk_tree_view_column_new_with_attributes (NULL, renderer, "text", column_id, NULL);
+	gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_expand (column, TRUE);
+
+	return column;
+}
+
+static void
+setup_language_list (CcLanguageChooser *chooser)
+{
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *column;
+	CcLanguageChooserPrivate *priv = chooser->priv;
+	GtkTreeView *view = GTK_TREE_VIEW (priv->language_list);
+
+	priv->store = gtk_list_store_new (N_COLUMNS,
+                                      G_TYPE_STRING,
+                                      G_TYPE_STRING,
+                                      G_TYPE_STRING,
+                                      G_TYPE_STRING);
+
+	priv->filter = gtk_tree_model_filter_new (GTK_TREE_MODEL (priv->store), NULL);
+	gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (priv->filter),
+                                            filter_visible_func, chooser, NULL);
+
+	gtk_tree_view_append_column (view, text_column_new (COLUMN_LANGUAGE_NAME, FALSE));
+
+	renderer = gtk_cell_renderer_pixbuf_new ();
+	column = gtk_tree_view_column_new ();
+	gtk_tree_view_column_pack_start (column, renderer, FALSE);
+	gtk_tree_view_column_set_cell_data_func (column, renderer,
+                                             checkmark_cell_data_func, chooser, NULL);
+	gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width (column, 32);
+	gtk_tree_view_append_column (view, column);
+
+	gtk_tree_view_append_column (view, text_column_new (COLUMN_COUNTRY_NAME, TRUE));
+
+	/* every row has the same height, so only the visible ones are
+	 * ever measured and rendered */
+	gtk_tree_view_set_fixed_height_mode (view, TRUE);
 }
 
 static void
 cc_language_chooser_finalize (GObject *object)
 {
 	CcLanguageChooser *chooser = CC_LANGUAGE_CHOOSER (object);
+	CcLanguageChooserPrivate *priv = chooser->priv;
 
-	g_free (chooser->priv->language);
+	g_clear_object (&priv->filter);
+	g_clear_object (&priv->store);
+	g_hash_table_destroy (priv->rows);
+	g_free (priv->filter_key);
+	g_free (priv->language);
 
 	G_OBJECT_CLASS (cc_language_chooser_parent_class)->finalize (object);
 }
@@ -390,19 +512,18 @@ cc_language_chooser_constructed (GObject *object)
 
 	G_OBJECT_CLASS (cc_language_chooser_parent_class)->constructed (object);
 
-	gtk_list_box_set_sort_func (GTK_LIST_BOX (priv->language_list),
-                                sort_languages, chooser, NULL);
-	gtk_list_box_set_header_func (GTK_LIST_BOX (priv->language_list),
-                                  update_header_func, chooser, NULL);
+	setup_language_list (chooser);
 
 	add_all_languages (chooser);
 
+	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->language_list), priv->filter);
+
 	g_signal_connect (priv->language_list, "row-activated", G_CALLBACK (row_activated), chooser);
+	g_signal_connect (priv->language_list, "key-press-event", G_CALLBACK (list_key_press_cb), chooser);
+	g_signal_connect (priv->search_entry, "search-changed", G_CALLBACK (search_changed_cb), chooser);
 
 	if (priv->language == NULL)
 		priv->language = cc_common_language_get_current_language ();
-
-	sync_all_checkmarks (chooser);
 }
 
 static void
@@ -410,7 +531,7 @@ cc_language_chooser_init (CcLanguageChooser *chooser)
 {
 	chooser->priv = cc_language_chooser_get_instance_private (chooser);
 
-	g_resources_register (language_get_resource ());
+	chooser->priv->rows = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
 	gtk_widget_init_template (GTK_WIDGET (chooser));
 }
@@ -423,6 +544,7 @@ cc_language_chooser_class_init (CcLanguageChooserClass *klass)
 	gtk_widget_class_set_template_from_resource (GTK_WIDGET_CLASS (klass),
 			"/kr/gooroom/initial-setup/pages/language/cc-language-chooser.ui");
 
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), CcLanguageChooser, search_entry);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), CcLanguageChooser, language_list);
 
 	object_class->finalize = cc_language_chooser_finalize;
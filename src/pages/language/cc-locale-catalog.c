@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <fontconfig/fontconfig.h>
+
+#define GNOME_DESKTOP_USE_UNSTABLE_API
+#include <libgnome-desktop/gnome-languages.h>
+
+#include "cc-locale-catalog.h"
+#include "cc-common-language.h"
+#include "cc-util.h"
+
+/*
+ * The catalog is a single serialized GVariant so that it can be mapped
+ * and used in place:
+ *
+ *   (u  format version
+ *    x  newest mtime of the fontconfig configuration and font directories
+ *    s  checksum of the installed locales list
+ *    a(sssssb)  locale id, language name, country name, locale name,
+ *               sort key, displayable; ordered by sort key)
+ */
+#define CATALOG_VERSION 1
+#define CATALOG_TYPE    "(uxsa(sssssb))"
+
+struct _CcLocaleCatalog {
+	GMappedFile *mapped_file;
+	GVariant    *entries;
+};
+
+
+static void
+update_newest_mtime (FcStrList *list, gint64 *newest)
+{
+	FcChar8 *path;
+	GStatBuf buf;
+
+	if (list == NULL)
+		return;
+
+	while ((path = FcStrListNext (list)) != NULL) {
+		if (g_stat ((const gchar *) path, &buf) == 0 && buf.st_mtime > *newest)
+			*newest = buf.st_mtime;
+	}
+
+	FcStrListDone (list);
+}
+
+static gint64
+get_fontconfig_mtime (void)
+{
+	gint64 newest = 0;
+	FcChar8 *filename;
+	GStatBuf buf;
+
+	filename = FcConfigFilename (NULL);
+	if (filename) {
+		if (g_stat ((const gchar *) filename, &buf) == 0)
+			newest = buf.st_mtime;
+		FcStrFree (filename);
+	}
+
+	update_newest_mtime (FcConfigGetConfigFiles (NULL), &newest);
+	update_newest_mtime (FcConfigGetFontDirs (NULL), &newest);
+
+	return newest;
+}
+
+static gchar *
+get_locales_checksum (gchar **locale_ids)
+{
+	guint i;
+	gchar *checksum;
+	GChecksum *sum = g_checksum_new (G_CHECKSUM_SHA256);
+
+	for (i = 0; locale_ids[i] != NULL; i++)
+		g_checksum_update (sum, (const guchar *) locale_ids[i], strlen (locale_ids[i]) + 1);
+
+	checksum = g_strdup (g_checksum_get_string (sum));
+	g_checksum_free (sum);
+
+	return checksum;
+}
+
+CcLocaleCatalog *
+cc_locale_catalog_load (const gchar  *filename,
+                        GError      **error)
+{
+	guint32 version;
+	gint64 mtime;
+	const gchar *checksum;
+	gchar *current_checksum;
+	gchar **locale_ids;
+	GBytes *bytes;
+	GVariant *root, *entries;
+	GMappedFile *mapped_file;
+	CcLocaleCatalog *catalog;
+
+	mapped_file = g_mapped_file_new (filename, FALSE, error);
+	if (mapped_file == NULL)
+		return NULL;
+
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	root = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (CATALOG_TYPE), bytes, FALSE));
+	g_bytes_unref (bytes);
+
+	g_variant_get (root, "(ux&s@a(sssssb))", &version, &mtime, &checksum, &entries);
+
+	locale_ids = gnome_get_all_locales ();
+	current_checksum = get_locales_checksum (locale_ids);
+	g_strfreev (locale_ids);
+
+	if (version != CATALOG_VERSION ||
+        mtime != get_fontconfig_mtime () ||
+        g_strcmp0 (checksum, current_checksum) != 0) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Locale catalog '%s' is out of date", filename);
+		g_free (current_checksum);
+		g_variant_unref (entries);
+		g_variant_unref (root);
+		g_mapped_file_unref (mapped_file);
+		return NULL;
+	}
+
+	g_free (current_checksum);
+	g_variant_unref (root);
+
+	catalog = g_new0 (CcLocaleCatalog, 1);
+	catalog->mapped_file = mapped_file;
+	catalog->entries = entries;
+
+	return catalog;
+}
+
+void
+cc_locale_catalog_free (CcLocaleCatalog *catalog)
+{
+	if (catalog == NULL)
+		return;
+
+	g_variant_unref (catalog->entries);
+	g_mapped_file_unref (catalog->mapped_file);
+	g_free (catalog);
+}
+
+guint
+cc_locale_catalog_get_n_entries (CcLocaleCatalog *catalog)
+{
+	return g_variant_n_children (catalog->entries);
+}
+
+/* The strings are owned by the catalog and stay valid until it is freed. */
+void
+cc_locale_catalog_get_entry (CcLocaleCatalog      *catalog,
+                             guint                 index,
+                             CcLocaleCatalogEntry *entry)
+{
+	g_variant_get_child (catalog->entries, index, "(&s&s&s&s&sb)",
+                         &entry->locale_id,
+                         &entry->language_name,
+                         &entry->country_name,
+                         &entry->locale_name,
+                         &entry->sort_key,
+                         &entry->displayable);
+
+	if (*entry->country_name == '\0')
+		entry->country_name = NULL;
+}
+
+typedef struct {
+	gchar *locale_id;
+	gchar *language_name;
+	gchar *country_name;
+	gchar *locale_name;
+	gchar *sort_key;
+	gboolean displayable;
+} CatalogRecord;
+
+static void
+catalog_record_free (gpointer data)
+{
+	CatalogRecord *record = data;
+
+	g_free (record->locale_id);
+	g_free (record->language_name);
+	g_free (record->country_name);
+	g_free (record->locale_name);
+	g_free (record->sort_key);
+	g_free (record);
+}
+
+static gint
+catalog_record_compare (gconstpointer a,
+                        gconstpointer b)
+{
+	const CatalogRecord *ra = *(const CatalogRecord **) a;
+	const CatalogRecord *rb = *(const CatalogRecord **) b;
+
+	return strcmp (ra->sort_key, rb->sort_key);
+}
+
+static CatalogRecord *
+catalog_record_new (const gchar *locale_id)
+{
+	gchar *language = NULL, *country = NULL;
+	CatalogRecord *record;
+
+	if (!gnome_parse_locale (locale_id, &language, &country, NULL, NULL))
+		return NULL;
+
+	record = g_new0 (CatalogRecord, 1);
+	record->locale_id = g_strdup (locale_id);
+	record->language_name = gnome_get_language_from_code (language, locale_id);
+	record->country_name = country ? gnome_get_country_from_code (country, locale_id) : NULL;
+	record->locale_name = gnome_get_language_from_locale (locale_id, locale_id);
+	record->sort_key = cc_util_normalize_casefold_and_unaccent (record->locale_name);
+	record->displayable = cc_common_language_has_font (locale_id);
+
+	if (record->language_name == NULL || record->sort_key == NULL) {
+		catalog_record_free (record);
+		record = NULL;
+	}
+
+	g_free (language);
+	g_free (country);
+
+	return record;
+}
+
+gboolean
+cc_locale_catalog_write (const gchar  *filename,
+                         GError      **error)
+{
+	guint i;
+	gboolean ret;
+	gchar *dirname, *checksum;
+	gchar **locale_ids;
+	GPtrArray *records;
+	GVariantBuilder builder;
+	GVariant *root;
+
+	locale_ids = gnome_get_all_locales ();
+	checksum = get_locales_checksum (locale_ids);
+
+	records = g_ptr_array_new_with_free_func (catalog_record_free);
+	for (i = 0; locale_ids[i] != NULL; i++) {
+		CatalogRecord *record = catalog_record_new (locale_ids[i]);
+		if (record)
+			g_ptr_array_add (records, record);
+	}
+	g_ptr_array_sort (records, catalog_record_compare);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sssssb)"));
+	for (i = 0; i < records->len; i++) {
+		CatalogRecord *record = g_ptr_array_index (records, i);
+		g_variant_builder_add (&builder, "(sssssb)",
+                               record->locale_id,
+                               record->language_name,
+                               record->country_name ? record->country_name : "",
+                               record->locale_name,
+                               record->sort_key,
+                               record->displayable);
+	}
+
+	root = g_variant_ref_sink (g_variant_new ("(uxsa(sssssb))",
+                                              CATALOG_VERSION,
+                                              get_fontconfig_mtime (),
+                                              checksum,
+                                              &builder));
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0755);
+	g_free (dirname);
+
+	ret = g_file_set_contents (filename,
+                               g_variant_get_data (root),
+                               g_variant_get_size (root),
+                               error);
+
+	g_variant_unref (root);
+	g_ptr_array_unref (records);
+	g_free (checksum);
+	g_strfreev (locale_ids);
+
+	return ret;
+}
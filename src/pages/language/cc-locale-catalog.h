@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CC_LOCALE_CATALOG_H__
+#define __CC_LOCALE_CATALOG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _CcLocaleCatalog CcLocaleCatalog;
+
+typedef struct {
+	const gchar *locale_id;
+	const gchar *language_name;
+	const gchar *country_name;
+	const gchar *locale_name;
+	const gchar *sort_key;
+	gboolean     displayable;
+} CcLocaleCatalogEntry;
+
+CcLocaleCatalog *cc_locale_catalog_load            (const gchar           *filename,
+                                                    GError               **error);
+void             cc_locale_catalog_free            (CcLocaleCatalog       *catalog);
+
+guint            cc_locale_catalog_get_n_entries   (CcLocaleCatalog       *catalog);
+void             cc_locale_catalog_get_entry       (CcLocaleCatalog       *catalog,
+                                                    guint                  index,
+                                                    CcLocaleCatalogEntry  *entry);
+
+gboolean         cc_locale_catalog_write           (const gchar           *filename,
+                                                    GError               **error);
+
+G_END_DECLS
+
+#endif /* __CC_LOCALE_CATALOG_H__ */
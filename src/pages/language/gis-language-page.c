@@ -25,7 +25,6 @@
 #include <config.h>
 #endif
 
-#include "language-resources.h"
 #include "cc-language-chooser.h"
 #include "gis-language-page.h"
 
@@ -127,6 +126,12 @@ gis_language_page_locale_changed (GisPage *page)
                           "After logging in, you can change the user's language in the settings."));
 }
 
+static gboolean
+gis_language_page_should_show (GisPage *page)
+{
+	return !gis_page_manager_has_preseed (page->manager, "Language", "Locale");
+}
+
 static void
 gis_language_page_dispose (GObject *object)
 {
@@ -140,8 +145,6 @@ gis_language_page_init (GisLanguagePage *page)
 
 	page->priv = gis_language_page_get_instance_private (page);
 
-	g_resources_register (language_get_resource ());
-
 	g_type_ensure (CC_TYPE_LANGUAGE_CHOOSER);
 
 	gtk_widget_init_template (GTK_WIDGET (page));
@@ -161,6 +164,7 @@ gis_language_page_class_init (GisLanguagePageClass *klass)
 	page_class->shown = gis_language_page_shown;
 	page_class->save_data = gis_language_page_save_data;
 	page_class->locale_changed = gis_language_page_locale_changed;
+	page_class->should_show = gis_language_page_should_show;
 
 	gtk_widget_class_set_template_from_resource (GTK_WIDGET_CLASS (klass),
 			"/kr/gooroom/initial-setup/pages/language/gis-language-page.ui");
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <locale.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "cc-locale-catalog.h"
+
+
+static gchar *output = NULL;
+
+
+static GOptionEntry option_entries[] =
+{
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, NULL, NULL },
+	{ NULL }
+};
+
+int
+main (int argc, char **argv)
+{
+	gint ret = 0;
+	GError *error = NULL;
+	gboolean retval;
+	GOptionContext *context;
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, option_entries, NULL);
+	retval = g_option_context_parse (context, &argc, &argv, &error);
+	g_option_context_free (context);
+
+	/* parse options */
+	if (!retval) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	if (!cc_locale_catalog_write (output ? output : LOCALE_CATALOG_FILE, &error)) {
+		g_warning ("Failed to write the locale catalog: %s", error->message);
+		g_error_free (error);
+		ret = 2;
+	}
+
+	g_free (output);
+
+	return ret;
+}
@@ -23,7 +23,6 @@
 #include <config.h>
 #endif
 
-#include "network-resources.h"
 #include "gis-network-page.h"
 #include "network-dialogs.h"
 #include "gis-connection-editor-window.h"
@@ -1170,6 +1169,36 @@ gis_network_page_locale_changed (GisPage *page)
                           _("Enable Networking"));
 }
 
+static void
+activate_preseed_connection (GisNetworkPage *page)
+{
+	gchar *id;
+	NMRemoteConnection *connection;
+	GisNetworkPagePrivate *priv = page->priv;
+	GisPageManager *manager = GIS_PAGE (page)->manager;
+
+	id = gis_page_manager_get_preseed_string (manager, "Network", "Connection");
+	if (!id)
+		return;
+
+	connection = nm_client_get_connection_by_id (priv->nm_client, id);
+	if (connection) {
+		nm_client_activate_connection_async (priv->nm_client,
+                                             NM_CONNECTION (connection), NULL,
+                                             NULL, NULL, connection_activate_cb, NULL);
+	} else {
+		g_warning ("Preseeded network connection '%s' not found", id);
+	}
+
+	g_free (id);
+}
+
+static gboolean
+gis_network_page_should_show (GisPage *page)
+{
+	return !gis_page_manager_has_preseed (page->manager, "Network", "Connection");
+}
+
 static void
 gis_network_page_dispose (GObject *object)
 {
@@ -1223,6 +1252,8 @@ gis_network_page_constructed (GObject *object)
 
 	start_action_for_networking_enabled (page);
 
+	activate_preseed_connection (page);
+
 out:
 	update_page_ui (page);
 
@@ -1239,8 +1270,6 @@ gis_network_page_init (GisNetworkPage *page)
 	priv->nm_device_wifi = NULL;
 	priv->old_network_enabled = TRUE;
 
-	g_resources_register (network_get_resource ());
-
 	gtk_widget_init_template (GTK_WIDGET (page));
 
 	gis_page_set_title (GIS_PAGE (page), _("Network Settings"));
@@ -1292,6 +1321,7 @@ gis_network_page_class_init (GisNetworkPageClass *klass)
 	gtk_widget_class_bind_template_child_private (widget_class, GisNetworkPage, network_enable_button);
 
 	page_class->locale_changed = gis_network_page_locale_changed;
+	page_class->should_show = gis_network_page_should_show;
 
 	object_class->constructed = gis_network_page_constructed;
 	object_class->dispose = gis_network_page_dispose;
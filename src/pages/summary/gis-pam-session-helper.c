@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Opens and closes one PAM session for a freshly created user so that
+ * the session modules (pam_ecryptfs in particular) set up the home
+ * directory. The password is read from stdin, the outcome is written to
+ * stdout as key=value lines:
+ *
+ *   stage=authenticate|open-session|close-session|done
+ *   status=<PAM return code of that stage>
+ *   message=<pam_strerror of that stage>
+ *   authenticate-usec=<time spent in pam_authenticate>
+ *   open-session-usec=<time spent in pam_open_session>
+ *   close-session-usec=<time spent in pam_close_session>
+ *
+ * It only works on accounts in the root-owned provision record, see
+ * gis-provision-record.c, and never on root or a system account.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <security/pam_appl.h>
+
+#include <glib.h>
+
+#include "gis-provision-record.h"
+
+/* Our own stack, see data/pam.d. The "su" stack lets root through
+ * pam_rootok without asking for the password, which would keep
+ * pam_ecryptfs from ever seeing it. */
+#define PAM_SERVICE "gooroom-initial-setup"
+
+#define LOGIN_DEFS      "/etc/login.defs"
+#define DEFAULT_UID_MIN 1000
+
+static gchar *user = NULL;
+
+
+static GOptionEntry option_entries[] =
+{
+	{ "username",     'u', 0, G_OPTION_ARG_STRING, &user,     NULL, NULL },
+    { NULL }
+};
+
+static uid_t
+get_uid_min (void)
+{
+	guint i;
+	gchar *contents = NULL;
+	gchar **lines;
+	uid_t uid_min = DEFAULT_UID_MIN;
+
+	if (!g_file_get_contents (LOGIN_DEFS, &contents, NULL, NULL))
+		return uid_min;
+
+	lines = g_strsplit (contents, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		gchar **fields = g_strsplit_set (g_strstrip (lines[i]), " \t", -1);
+		guint n = g_strv_length (fields);
+
+		if (n >= 2 && g_str_equal (fields[0], "UID_MIN")) {
+			guint64 value;
+			if (g_ascii_string_to_unsigned (fields[n - 1], 10, 1, G_MAXUINT32, &value, NULL))
+				uid_min = value;
+		}
+		g_strfreev (fields);
+	}
+
+	g_strfreev (lines);
+	g_free (contents);
+
+	return uid_min;
+}
+
+/* A regular account, not root or a system one */
+static gboolean
+is_valid_username (const char *user)
+{
+	struct passwd pw, *pwp;
+	char buf[4096] = {0,};
+
+	getpwnam_r (user, &pw, buf, sizeof (buf), &pwp);
+
+	return (pwp != NULL && pwp->pw_uid != 0 && pwp->pw_uid >= get_uid_min ());
+}
+
+static gchar *
+read_password (void)
+{
+	gchar buf[1024] = {0,};
+	gsize len;
+
+	if (fgets (buf, sizeof (buf), stdin) == NULL)
+		return NULL;
+
+	len = strlen (buf);
+	if (len > 0 && buf[len - 1] == '\n')
+		buf[len - 1] = '\0';
+
+	return g_strdup (buf);
+}
+
+/* Answers every hidden prompt with the password, nothing is ever shown */
+static int
+conversation (int                        num_msg,
+              const struct pam_message **msg,
+              struct pam_response      **resp,
+              void                      *appdata_ptr)
+{
+	int i;
+	struct pam_response *reply;
+
+	if (num_msg <= 0)
+		return PAM_CONV_ERR;
+
+	reply = calloc (num_msg, sizeof (struct pam_response));
+	if (reply == NULL)
+		return PAM_BUF_ERR;
+
+	for (i = 0; i < num_msg; i++) {
+		switch (msg[i]->msg_style) {
+			case PAM_PROMPT_ECHO_OFF:
+				reply[i].resp = strdup ((const char *) appdata_ptr);
+			break;
+
+			case PAM_ERROR_MSG:
+			case PAM_TEXT_INFO:
+				g_debug ("PAM: %s", msg[i]->msg);
+			break;
+
+			default:
+				/* nobody is there to answer a visible prompt */
+				for (; i >= 0; i--) {
+					if (reply[i].resp) {
+						memset (reply[i].resp, 0, strlen (reply[i].resp));
+						free (reply[i].resp);
+					}
+				}
+				free (reply);
+				return PAM_CONV_ERR;
+		}
+	}
+
+	*resp = reply;
+
+	return PAM_SUCCESS;
+}
+
+static void
+print_result (pam_handle_t *pamh,
+              const gchar  *stage,
+              int           status,
+              gint64        times[3])
+{
+	printf ("stage=%s\n", stage);
+	printf ("status=%d\n", status);
+	printf ("message=%s\n", pam_strerror (pamh, status));
+	printf ("authenticate-usec=%" G_GINT64_FORMAT "\n", times[0]);
+	printf ("open-session-usec=%" G_GINT64_FORMAT "\n", times[1]);
+	printf ("close-session-usec=%" G_GINT64_FORMAT "\n", times[2]);
+	fflush (stdout);
+}
+
+int
+main (int argc, char **argv)
+{
+	gint ret = 0;
+	int status;
+	gint64 start, times[3] = { 0, };
+	const gchar *stage;
+	gchar *password = NULL;
+	gboolean retval;
+	GError *error = NULL;
+	GOptionContext *context;
+	pam_handle_t *pamh = NULL;
+	struct pam_conv conv = { conversation, NULL };
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, option_entries, NULL);
+	retval = g_option_context_parse (context, &argc, &argv, &error);
+	g_option_context_free (context);
+
+	/* parse options */
+	if (!retval) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		ret = 1;
+		goto done;
+	}
+
+	if (!user) {
+		g_warning ("No user was specified.");
+		ret = 2;
+		goto done;
+	}
+
+	if (!is_valid_username (user)) {
+		g_warning ("Invalid user");
+		ret = 3;
+		goto done;
+	}
+
+	if (!gis_provision_record_contains (user)) {
+		g_warning ("%s was not provisioned by initial setup", user);
+		ret = 3;
+		goto done;
+	}
+
+	password = read_password ();
+	if (!password) {
+		g_warning ("No password was given.");
+		ret = 4;
+		goto done;
+	}
+
+	conv.appdata_ptr = password;
+
+	stage = "authenticate";
+	status = pam_start (PAM_SERVICE, user, &conv, &pamh);
+	if (status != PAM_SUCCESS)
+		goto out;
+
+	start = g_get_monotonic_time ();
+	status = pam_authenticate (pamh, PAM_SILENT);
+	times[0] = g_get_monotonic_time () - start;
+	if (status != PAM_SUCCESS)
+		goto out;
+
+	stage = "open-session";
+	start = g_get_monotonic_time ();
+	status = pam_open_session (pamh, PAM_SILENT);
+	times[1] = g_get_monotonic_time () - start;
+	if (status != PAM_SUCCESS)
+		goto out;
+
+	stage = "close-session";
+	start = g_get_monotonic_time ();
+	status = pam_close_session (pamh, PAM_SILENT);
+	times[2] = g_get_monotonic_time () - start;
+	if (status != PAM_SUCCESS)
+		goto out;
+
+	stage = "done";
+
+out:
+	print_result (pamh, stage, status, times);
+
+	if (status != PAM_SUCCESS)
+		ret = 5;
+
+	if (pamh)
+		pam_end (pamh, status);
+
+done:
+	if (password) {
+		memset (password, 0, strlen (password));
+		g_free (password);
+	}
+	g_free (user);
+
+	return ret;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * The accounts initial setup has provisioned, one user name per line,
+ * in a file only root can write. The root helpers add a name when they
+ * first see it unused, with no account and no home, and afterwards only
+ * act on names in the record. So they never touch an account or a home
+ * that existed before the setup ran, whatever name the caller passes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
+#include "gis-provision-record.h"
+
+#define RECORD_FILE GIS_STATE_DIR "/provisioned-users"
+
+
+static gchar **
+read_record (void)
+{
+	gchar *contents = NULL;
+	gchar **names;
+	struct stat buf;
+
+	/* anything but a root-owned regular file is not our record */
+	if (g_lstat (RECORD_FILE, &buf) != 0 ||
+        !S_ISREG (buf.st_mode) || buf.st_uid != 0 || (buf.st_mode & 022) != 0)
+		return g_new0 (gchar *, 1);
+
+	if (!g_file_get_contents (RECORD_FILE, &contents, NULL, NULL))
+		return g_new0 (gchar *, 1);
+
+	names = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	return names;
+}
+
+gboolean
+gis_provision_record_contains (const gchar *user)
+{
+	gboolean ret;
+	gchar **names;
+
+	names = read_record ();
+	ret = g_strv_contains ((const gchar * const *) names, user);
+	g_strfreev (names);
+
+	return ret;
+}
+
+gboolean
+gis_provision_record_add (const gchar  *user,
+                          GError      **error)
+{
+	guint i;
+	gboolean ret;
+	gchar **names;
+	GString *contents;
+
+	if (g_mkdir_with_parents (GIS_STATE_DIR, 0700) != 0) {
+		int saved_errno = errno;
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                     "Failed to create %s: %s", GIS_STATE_DIR, g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	names = read_record ();
+	if (g_strv_contains ((const gchar * const *) names, user)) {
+		g_strfreev (names);
+		return TRUE;
+	}
+
+	contents = g_string_new (NULL);
+	for (i = 0; names[i] != NULL; i++) {
+		if (*names[i] != '\0')
+			g_string_append_printf (contents, "%s\n", names[i]);
+	}
+	g_string_append_printf (contents, "%s\n", user);
+
+	/* written to a temporary file and renamed into place */
+	ret = g_file_set_contents (RECORD_FILE, contents->str, contents->len, error);
+
+	g_string_free (contents, TRUE);
+	g_strfreev (names);
+
+	return ret;
+}
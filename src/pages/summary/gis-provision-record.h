@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __GIS_PROVISION_RECORD_H__
+#define __GIS_PROVISION_RECORD_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean gis_provision_record_contains (const gchar  *user);
+gboolean gis_provision_record_add      (const gchar  *user,
+                                        GError      **error);
+
+G_END_DECLS
+
+#endif /* __GIS_PROVISION_RECORD_H__ */
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Removes what is left of a user's home, /home/<user> and
+ * /home/.ecryptfs/<user>, and writes what it removed to stdout:
+ *
+ *   entries=<number of files and directories removed>
+ *   bytes=<their apparent size>
+ *   errors=<number of entries that could not be removed>
+ *
+ * Everything goes through file descriptors opened with O_NOFOLLOW and
+ * unlinkat(), so a symlink anywhere in the tree is removed rather than
+ * followed, and nothing on another file system than the top directory
+ * is entered. The top level directories of a home are removed in
+ * parallel.
+ *
+ * It refuses an existing account, and a name that is not in the
+ * provision record unless nothing of it exists yet, in which case the
+ * name is recorded. The homes of other users are never touched.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gis-provision-record.h"
+
+static gchar *user = NULL;
+
+/* shared by the workers */
+static GMutex counters_lock;
+static gint64 n_entries = 0;
+static gint64 n_bytes = 0;
+static gint n_errors = 0;
+
+
+static GOptionEntry option_entries[] =
+{
+	{ "username",     'u', 0, G_OPTION_ARG_STRING, &user,     NULL, NULL },
+    { NULL }
+};
+
+typedef struct {
+	int    parent_fd;
+	gchar *name;
+	dev_t  dev;         /* of the top directory */
+} RemoveJob;
+
+static void
+count_removed (const struct stat *buf)
+{
+	g_mutex_lock (&counters_lock);
+	n_entries++;
+	n_bytes += buf->st_size;
+	g_mutex_unlock (&counters_lock);
+}
+
+static void
+count_error (const gchar *name)
+{
+	g_warning ("Failed to remove %s: %s", name, g_strerror (errno));
+
+	g_mutex_lock (&counters_lock);
+	n_errors++;
+	g_mutex_unlock (&counters_lock);
+}
+
+/* A mount point inside the home is left alone, with whatever is mounted
+ * there */
+static gboolean
+is_other_device (const gchar       *name,
+                 const struct stat *buf,
+                 dev_t              dev)
+{
+	if (buf->st_dev == dev)
+		return FALSE;
+
+	errno = EXDEV;
+	count_error (name);
+
+	return TRUE;
+}
+
+/* Empties the directory @fd on @dev, which is closed afterwards */
+static void
+remove_dir_contents (int   fd,
+                     dev_t dev)
+{
+	DIR *dir;
+	struct dirent *entry;
+	struct stat buf;
+
+	dir = fdopendir (fd);
+	if (dir == NULL) {
+		count_error ("directory");
+		close (fd);
+		return;
+	}
+
+	while ((entry = readdir (dir)) != NULL) {
+		int child;
+
+		if (g_str_equal (entry->d_name, ".") || g_str_equal (entry->d_name, ".."))
+			continue;
+
+		if (fstatat (fd, entry->d_name, &buf, AT_SYMLINK_NOFOLLOW) != 0) {
+			count_error (entry->d_name);
+			continue;
+		}
+
+		if (is_other_device (entry->d_name, &buf, dev))
+			continue;
+
+		if (S_ISDIR (buf.st_mode)) {
+			child = openat (fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if (child < 0) {
+				count_error (entry->d_name);
+				continue;
+			}
+
+			remove_dir_contents (child, dev);
+
+			if (unlinkat (fd, entry->d_name, AT_REMOVEDIR) != 0) {
+				count_error (entry->d_name);
+				continue;
+			}
+		} else if (unlinkat (fd, entry->d_name, 0) != 0) {
+			count_error (entry->d_name);
+			continue;
+		}
+
+		count_removed (&buf);
+	}
+
+	closedir (dir);
+}
+
+static void
+remove_job_func (gpointer data,
+                 gpointer user_data)
+{
+	int fd;
+	struct stat buf;
+	RemoveJob *job = data;
+
+	if (fstatat (job->parent_fd, job->name, &buf, AT_SYMLINK_NOFOLLOW) != 0) {
+		count_error (job->name);
+		goto out;
+	}
+
+	if (is_other_device (job->name, &buf, job->dev))
+		goto out;
+
+	fd = openat (job->parent_fd, job->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		count_error (job->name);
+		goto out;
+	}
+
+	/* it may have been replaced since the check above */
+	if (fstat (fd, &buf) != 0 || is_other_device (job->name, &buf, job->dev)) {
+		close (fd);
+		goto out;
+	}
+
+	remove_dir_contents (fd, job->dev);
+
+	if (unlinkat (job->parent_fd, job->name, AT_REMOVEDIR) != 0)
+		count_error (job->name);
+	else
+		count_removed (&buf);
+
+out:
+	g_free (job->name);
+	g_free (job);
+}
+
+/* Removes @path; its subdirectories are removed in parallel, the
+ * rest right here */
+static void
+remove_tree (const gchar *path)
+{
+	int fd;
+	DIR *dir;
+	guint i;
+	struct dirent *entry;
+	struct stat buf, top;
+	GPtrArray *subdirs;
+	GThreadPool *pool;
+
+	fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			count_error (path);
+		return;
+	}
+
+	if (fstat (fd, &top) != 0 || (dir = fdopendir (fd)) == NULL) {
+		count_error (path);
+		close (fd);
+		return;
+	}
+
+	subdirs = g_ptr_array_new ();
+
+	while ((entry = readdir (dir)) != NULL) {
+		if (g_str_equal (entry->d_name, ".") || g_str_equal (entry->d_name, ".."))
+			continue;
+
+		if (fstatat (fd, entry->d_name, &buf, AT_SYMLINK_NOFOLLOW) != 0) {
+			count_error (entry->d_name);
+			continue;
+		}
+
+		if (is_other_device (entry->d_name, &buf, top.st_dev))
+			continue;
+
+		if (S_ISDIR (buf.st_mode)) {
+			RemoveJob *job = g_new0 (RemoveJob, 1);
+			job->parent_fd = fd;
+			job->name = g_strdup (entry->d_name);
+			job->dev = top.st_dev;
+			g_ptr_array_add (subdirs, job);
+		} else if (unlinkat (fd, entry->d_name, 0) != 0) {
+			count_error (entry->d_name);
+		} else {
+			count_removed (&buf);
+		}
+	}
+
+	/* queued only after reading, since the workers change the directory */
+	pool = g_thread_pool_new (remove_job_func, NULL,
+                              MAX (g_get_num_processors (), 2), FALSE, NULL);
+	for (i = 0; i < subdirs->len; i++)
+		g_thread_pool_push (pool, g_ptr_array_index (subdirs, i), NULL);
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	g_ptr_array_unref (subdirs);
+	closedir (dir);
+
+	if (rmdir (path) != 0)
+		count_error (path);
+	else
+		count_removed (&top);
+}
+
+static gboolean
+is_valid_name (const gchar *name)
+{
+	return name && *name &&
+           strchr (name, '/') == NULL &&
+           !g_str_equal (name, ".") &&
+           !g_str_equal (name, "..");
+}
+
+static gboolean
+is_existing_account (const gchar *name)
+{
+	struct passwd pw, *pwp;
+	char buf[4096] = {0,};
+
+	getpwnam_r (name, &pw, buf, sizeof (buf), &pwp);
+
+	return (pwp != NULL);
+}
+
+/* Only what initial setup created may go, see gis-provision-record.c */
+static gboolean
+may_remove (const gchar  *name,
+            gchar       **paths,
+            guint         n_paths)
+{
+	guint i;
+	struct stat buf;
+	GError *error = NULL;
+
+	if (is_existing_account (name)) {
+		g_warning ("%s is an existing account", name);
+		return FALSE;
+	}
+
+	if (gis_provision_record_contains (name))
+		return TRUE;
+
+	for (i = 0; i < n_paths; i++) {
+		if (g_lstat (paths[i], &buf) == 0) {
+			g_warning ("%s was not created by initial setup", paths[i]);
+			return FALSE;
+		}
+	}
+
+	if (!gis_provision_record_add (name, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+	guint i;
+	gint ret = 0;
+	gboolean retval;
+	gchar *paths[2];
+	GError *error = NULL;
+	GOptionContext *context;
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, option_entries, NULL);
+	retval = g_option_context_parse (context, &argc, &argv, &error);
+	g_option_context_free (context);
+
+	/* parse options */
+	if (!retval) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		ret = 1;
+		goto done;
+	}
+
+	if (!is_valid_name (user)) {
+		g_warning ("No valid user was specified.");
+		ret = 2;
+		goto done;
+	}
+
+	paths[0] = g_build_filename ("/home", user, NULL);
+	paths[1] = g_build_filename ("/home/.ecryptfs", user, NULL);
+
+	if (may_remove (user, paths, G_N_ELEMENTS (paths))) {
+		for (i = 0; i < G_N_ELEMENTS (paths); i++)
+			remove_tree (paths[i]);
+	} else {
+		ret = 4;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (paths); i++)
+		g_free (paths[i]);
+
+	if (ret != 0)
+		goto done;
+
+	printf ("entries=%" G_GINT64_FORMAT "\n", n_entries);
+	printf ("bytes=%" G_GINT64_FORMAT "\n", n_bytes);
+	printf ("errors=%d\n", n_errors);
+
+	if (n_errors > 0)
+		ret = 3;
+
+done:
+	g_free (user);
+
+	return ret;
+}
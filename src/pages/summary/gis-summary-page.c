@@ -24,19 +24,23 @@
 #endif
 
 #include <pwd.h>
+#include <grp.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
-#include "summary-resources.h"
 #include "gis-summary-page.h"
 #include "gis-keyring.h"
 #include "run-passwd.h"
 #include "run-su.h"
+#include "provision-graph.h"
+#include "provision-journal.h"
 #include "splash-window.h"
 #include "gis-message-dialog.h"
+#include "gis-image.h"
 
 
 #define GNOME_DESKTOP_USE_UNSTABLE_API
@@ -50,6 +54,7 @@ enum {
 
 struct _GisSummaryPagePrivate {
 	GtkWidget *setup_done_label;
+	GtkWidget *success_image;
 	GtkWidget *os_label;
 	GtkWidget *os_text_label;
 	GtkWidget *hostname_label;
@@ -64,10 +69,21 @@ struct _GisSummaryPagePrivate {
 	GtkWidget *online_accounts_text_label;
 
 	SplashWindow *splash;
+
+	PasswdHandler *passwd_handler;
+	ProvisionGraph *graph;
+	ProvisionJournal *journal;
+	gboolean starting;      /* rolling back before the graph runs */
+
+	gchar *keyring_password;    /* what this process changed the keyring to */
+	gboolean reset_keyring;     /* an earlier change broke off, the password is unknown */
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GisSummaryPage, gis_summary_page, GIS_TYPE_PAGE);
 
+#define GIS_SUMMARY_ERROR (gis_summary_error_quark ())
+G_DEFINE_QUARK (gis-summary-error, gis_summary_error)
+
 
 
 static void
@@ -107,42 +123,280 @@ delete_lightdm_config (void)
 }
 
 static void
-remove_after_checking_file_exists (GisSummaryPage *page, const gchar *username)
+home_removed_cb (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
 {
-	gchar *cmd = NULL;
-	gchar **argv;
+	guint i;
+	gchar *output = NULL;
+	gchar **lines;
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	gint64 *start_time = g_task_get_task_data (task);
+	const gchar *entries = "0", *bytes = "0";
+
+	if (!g_subprocess_communicate_utf8_finish (G_SUBPROCESS (source_object), res, &output, NULL, &error)) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
 
-	cmd = g_strdup_printf("/home/.ecryptfs/%s", username);
-	if (g_file_test (cmd, G_FILE_TEST_EXISTS)) {
-		cmd = g_strdup_printf ("sudo /usr/bin/rm -rf %s",cmd);
-		g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL);
+	lines = g_strsplit (output ? output : "", "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		if (g_str_has_prefix (lines[i], "entries="))
+			entries = lines[i] + strlen ("entries=");
+		else if (g_str_has_prefix (lines[i], "bytes="))
+			bytes = lines[i] + strlen ("bytes=");
 	}
 
-	cmd = g_strdup_printf("/home/%s", username);
-	if (g_file_test (cmd, G_FILE_TEST_EXISTS)) {
-		cmd = g_strdup_printf ("sudo /usr/bin/rm -rf %s",cmd);
-		g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL);
+	g_debug ("Removed %s entries, %s bytes in %.1f ms", entries, bytes,
+             (g_get_monotonic_time () - *start_time) / 1000.0);
+
+	if (g_subprocess_get_exit_status (G_SUBPROCESS (source_object)) != 0) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                 "%s could not remove everything", GIS_REMOVE_HOME_HELPER);
+	} else {
+		g_task_return_boolean (task, TRUE);
 	}
 
-	g_free(argv);
-	g_free(cmd);
+	g_strfreev (lines);
+	g_free (output);
+	g_object_unref (task);
 }
 
+/* Removes /home/<user> and /home/.ecryptfs/<user> without blocking.
+ * With @record the helper runs even if there is nothing to remove, so
+ * that it records the name as one this setup provisions; the other
+ * root helpers only act on recorded names. */
 static void
-delete_account (const char *user)
+remove_home_async (const gchar         *username,
+                   gboolean             record,
+                   GAsyncReadyCallback  callback,
+                   gpointer             user_data)
 {
-	gchar *cmd = NULL;
+	GTask *task;
+	gint64 *start_time;
+	gchar *home, *ecryptfs;
+	gboolean exists;
+	GError *error = NULL;
+	GSubprocess *subprocess;
+
+	task = g_task_new (NULL, NULL, callback, user_data);
+
+	start_time = g_new (gint64, 1);
+	*start_time = g_get_monotonic_time ();
+	g_task_set_task_data (task, start_time, g_free);
+
+	home = g_build_filename ("/home", username, NULL);
+	ecryptfs = g_build_filename ("/home/.ecryptfs", username, NULL);
+	exists = g_file_test (home, G_FILE_TEST_EXISTS) || g_file_test (ecryptfs, G_FILE_TEST_EXISTS);
+	g_free (home);
+	g_free (ecryptfs);
+
+	/* nothing to remove, no need to ask for privileges */
+	if (!exists && !record) {
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error,
+                                   "/usr/bin/pkexec", GIS_REMOVE_HOME_HELPER, "-u", username, NULL);
+	if (subprocess == NULL) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	g_subprocess_communicate_utf8_async (subprocess, NULL, NULL, home_removed_cb, task);
+	g_object_unref (subprocess);
+}
+
+static gboolean
+remove_home_finish (GAsyncResult  *res,
+                    GError       **error)
+{
+	return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static void
+account_home_removed_cb (GObject      *source_object,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+
+	if (!remove_home_finish (res, &error)) {
+		g_warning ("Couldn't remove the home of %s: %s",
+                   (gchar *) g_task_get_task_data (task), error->message);
+		g_error_free (error);
+	}
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+static void
+userdel_done_cb (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	const gchar *user = g_task_get_task_data (task);
+
+	if (!g_subprocess_wait_check_finish (G_SUBPROCESS (source_object), res, NULL))
+		g_warning ("Couldn't delete account: %s", user);
+
+	remove_home_async (user, FALSE, account_home_removed_cb, task);
+}
+
+static void
+delete_account_async (const char          *user,
+                      GAsyncReadyCallback  callback,
+                      gpointer             user_data)
+{
+	GTask *task;
+	GError *error = NULL;
+	GSubprocess *subprocess;
+
+	task = g_task_new (NULL, NULL, callback, user_data);
+	g_task_set_task_data (task, g_strdup (user), g_free);
 
 	if (is_valid_username (user)) {
-		cmd = g_strdup_printf ("/usr/bin/pkexec /usr/sbin/userdel -rf %s", user);
-		if (!g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL)) {
-			g_warning ("Couldn't delete account: %s", user);
+		subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_SILENCE | G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+                                       &error,
+                                       "/usr/bin/pkexec", "/usr/sbin/userdel", "-rf", user, NULL);
+		if (subprocess) {
+			g_subprocess_wait_check_async (subprocess, NULL, userdel_done_cb, task);
+			g_object_unref (subprocess);
+			return;
 		}
+
+		g_warning ("Couldn't delete account: %s: %s", user, error->message);
+		g_error_free (error);
 	}
 
-	remove_after_checking_file_exists (NULL, user);
+	/* whatever userdel left behind */
+	remove_home_async (user, FALSE, account_home_removed_cb, task);
+}
 
-	g_free (cmd);
+static gchar *
+get_journal_filename (void)
+{
+	return g_build_filename (g_get_user_config_dir (), "gooroom-initial-setup", "provisioning.journal", NULL);
+}
+
+static void
+clear_password (gchar **password)
+{
+	if (*password) {
+		memset (*password, 0, strlen (*password));
+		g_clear_pointer (password, g_free);
+	}
+}
+
+static void
+keyring_restored_cb (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	GisSummaryPage *page = g_task_get_source_object (task);
+
+	if (!gis_reset_login_keyring_finish (res, &error)) {
+		/* the next keyring step fails and offers the rollback again */
+		g_warning ("Failed to reset the login keyring: %s", error->message);
+		g_error_free (error);
+	}
+
+	provision_journal_clear (page->priv->journal);
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+static void
+keyring_changed_back_cb (GObject      *source_object,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	GisSummaryPage *page = g_task_get_source_object (task);
+
+	if (!gis_update_login_keyring_password_finish (res, &error)) {
+		g_warning ("Failed to change the keyring password back: %s", error->message);
+		g_error_free (error);
+		gis_reset_login_keyring_async (NULL, keyring_restored_cb, task);
+		return;
+	}
+
+	clear_password (&page->priv->keyring_password);
+	provision_journal_clear (page->priv->journal);
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/* The keyring outlives the account, so it has to get the setup password
+ * back: changed back while this process still knows the password it
+ * was changed to, and replaced by a new keyring otherwise. The journal
+ * is cleared after that, nothing is left to resume. */
+static void
+rollback_keyring (GTask *task)
+{
+	GisSummaryPage *page = g_task_get_source_object (task);
+	GisSummaryPagePrivate *priv = page->priv;
+
+	if (provision_journal_get_state (priv->journal, "keyring") == PROVISION_STEP_NONE) {
+		provision_journal_clear (priv->journal);
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+	} else if (priv->keyring_password) {
+		gis_update_login_keyring_password_async (priv->keyring_password, NULL, NULL,
+                                                 keyring_changed_back_cb, task);
+	} else {
+		gis_reset_login_keyring_async (NULL, keyring_restored_cb, task);
+	}
+}
+
+static void
+rollback_account_deleted_cb (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+
+	g_task_propagate_boolean (G_TASK (res), NULL);
+
+	rollback_keyring (task);
+}
+
+/* Undoes what the journal recorded. Every undo can be repeated, so a
+ * crash in here only means that it runs again next time. */
+static void
+rollback_provisioning_async (GisSummaryPage      *page,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+	GTask *task;
+	gchar *user;
+	ProvisionJournal *journal = page->priv->journal;
+
+	task = g_task_new (page, NULL, callback, user_data);
+
+	user = provision_journal_dup_user (journal);
+
+	if (user && provision_journal_get_state (journal, "adduser") != PROVISION_STEP_NONE) {
+		g_debug ("Rolling back provisioning of %s", user);
+		delete_account_async (user, rollback_account_deleted_cb, task);
+	} else {
+		rollback_keyring (task);
+	}
+
+	g_free (user);
 }
 
 static gboolean
@@ -205,6 +459,24 @@ system_logout_cb (gpointer user_data)
 	return FALSE;
 }
 
+static void start_provisioning (GisSummaryPage *page);
+
+static void
+rolled_back_restart_cb (GObject      *source_object,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+	system_restart_cb (source_object);
+}
+
+static gboolean
+retry_provisioning_cb (gpointer user_data)
+{
+	start_provisioning (GIS_SUMMARY_PAGE (user_data));
+
+	return FALSE;
+}
+
 static void
 show_error_dialog (GisSummaryPage *page,
                    int             error_code,
@@ -212,12 +484,15 @@ show_error_dialog (GisSummaryPage *page,
                    const gchar    *message)
 {
 	int res;
-	gchar *username = NULL;
-    GtkWidget *dialog, *toplevel;
-	GisSummaryPagePrivate *priv = page->priv;
+	GtkWidget *dialog, *toplevel;
 	GisPageManager *manager = GIS_PAGE (page)->manager;
 
-	gis_page_manager_get_user_info (manager, NULL, &username, NULL);
+	/* the journal is kept, the next run resumes from it */
+	if (gis_page_manager_get_unattended (manager)) {
+		g_warning ("%s: %s", title, message);
+		gis_page_manager_unattended_done (manager, FALSE);
+		return;
+	}
 
 	toplevel = gtk_widget_get_toplevel (GTK_WIDGET (page));
 
@@ -231,7 +506,7 @@ show_error_dialog (GisSummaryPage *page,
         error_code == ENV_CONFIGURATION_ERROR)
 	{
 		gtk_dialog_add_buttons (GTK_DIALOG (dialog),
-                                _("_Ok"), GTK_RESPONSE_OK,
+                                _("_Retry"), GTK_RESPONSE_OK,
                                 _("_Cancel"), GTK_RESPONSE_CANCEL,
                                 NULL);
 		gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_OK);
@@ -240,12 +515,12 @@ show_error_dialog (GisSummaryPage *page,
 		gtk_widget_destroy (dialog);
 
 		if (res == GTK_RESPONSE_OK) {
-			delete_account (username);
-			g_idle_add ((GSourceFunc)system_restart_cb, page);
+			/* finished steps are skipped */
+			g_idle_add ((GSourceFunc)retry_provisioning_cb, page);
+		} else {
+			rollback_provisioning_async (page, rolled_back_restart_cb, NULL);
 		}
 	}
-
-	g_free (username);
 }
 
 static void
@@ -262,67 +537,28 @@ show_splash_window (GisSummaryPage *page)
 	splash_window_set_message_label (SPLASH_WINDOW (priv->splash), message);
 }
 
-static char *
-get_item (const char *buffer, const char *name)
-{
-	char end_char;
-	char *label, *start, *end, *result;
-
-	result = NULL;
-	start = NULL;
-	end = NULL;
-	label = g_strconcat (name, "=", NULL);
-	if ((start = strstr (buffer, label)) != NULL) {
-		start += strlen (label);
-		end_char = '\n';
-		if (*start == '"') {
-			start++;
-			end_char = '"';
-		}
-
-		end = strchr (start, end_char);
-	}
-
-	if (start != NULL && end != NULL)
-		result = g_strndup (start, end - start);
-
-	g_free (label);
-
-	return result;
-}
-
 static void
 update_online_accounts_info (GisSummaryPage *page)
 {
-	guint length;
-	gchar *text = NULL;
-	GList *online_accounts = NULL;
+	GList *l;
+	GString *text;
 	GisSummaryPagePrivate *priv = page->priv;
 	GisPageManager *manager = GIS_PAGE (page)->manager;
 
-	online_accounts = gis_page_manager_get_online_accounts (manager);
-
-	length = g_list_length (online_accounts);
-
-	if (length == 0) {
-		text = NULL;
-	} else if (length == 1) {
-		text = g_strdup_printf ("%s", (gchar *)g_list_nth_data (online_accounts, 0));
-	} else {
-		guint i;
-		GString *string = g_string_new ("");
-		for (i = 0; i < length -1; i++)
-			g_string_append_printf (string, "%s, ", (gchar *)g_list_nth_data (online_accounts, i));
-		g_string_append_printf (string, "%s", (gchar *)g_list_nth_data (online_accounts, i));
-
-		text = g_strdup (string->str);
+	text = g_string_new (NULL);
 
-		g_string_free (string, TRUE);
+	for (l = gis_page_manager_get_online_accounts (manager); l; l = l->next) {
+		if (text->len > 0)
+			g_string_append (text, ", ");
+		g_string_append (text, (const gchar *) l->data);
 	}
-	if (text)
-		gtk_label_set_text (GTK_LABEL (priv->online_accounts_label), text);
+
+	if (text->len > 0)
+		gtk_label_set_text (GTK_LABEL (priv->online_accounts_label), text->str);
 	else
 		gtk_label_set_text (GTK_LABEL (priv->online_accounts_label), _("No Use"));
+
+	g_string_free (text, TRUE);
 }
 
 static void
@@ -347,28 +583,14 @@ update_user_info (GisSummaryPage *page)
 static void
 update_lang_info (GisSummaryPage *page)
 {
-	GisSummaryPagePrivate *priv = page->priv;
-
 	const gchar *locale;
-	gchar *locale_name = NULL;
+	gchar *locale_name;
+	GisSummaryPagePrivate *priv = page->priv;
+	GisSystemInfo *info = gis_page_manager_get_system_info (GIS_PAGE (page)->manager);
 
 	locale = g_getenv ("LANG");
-	if (!locale) {
-		gsize len, i;
-		gchar *buffer = NULL;
-		if (g_file_get_contents ("/etc/default/locale", &buffer, &len, NULL)) {
-			for (i = 0; i < len; i++) {
-				if (buffer[i] == '\n')
-					buffer[i] = '\0';
-			}
-			gchar **items = g_strsplit (buffer, "=", -1);
-			if (items && g_strv_length (items) > 1)
-				locale = items[1];
-
-			g_strfreev (items);
-		}
-		g_free (buffer);
-	}
+	if (!locale)
+		locale = gis_system_info_get_default_locale (info);
 
 	locale_name = locale ? gnome_get_language_from_locale (locale, locale) : g_strdup (_("Unknown"));
 
@@ -380,62 +602,55 @@ update_lang_info (GisSummaryPage *page)
 static void
 update_distro_info (GisSummaryPage *page)
 {
-	char *buffer;
-	char *name;
-	char *text;
+	const gchar *name;
 	GisSummaryPagePrivate *priv = page->priv;
+	GisSystemInfo *info = gis_page_manager_get_system_info (GIS_PAGE (page)->manager);
 
-	name = NULL;
+	name = gis_system_info_get_os_name (info);
 
-	if (g_file_get_contents ("/etc/os-release", &buffer, NULL, NULL)) {
-		name = get_item (buffer, "NAME");
-		g_free (buffer);
-	}
-
-	if (!name)
-		name = g_strdup ("Debian");
-
-	gtk_label_set_text (GTK_LABEL (priv->os_label), name);
-
-	g_free (name);
+	gtk_label_set_text (GTK_LABEL (priv->os_label), name ? name : "Debian");
 }
 
 static void
 update_hostname_info (GisSummaryPage *page)
 {
-	gsize len, i;
-	gchar *buffer = NULL;
-	const gchar *hostname = NULL;
+	const gchar *hostname;
 	GisSummaryPagePrivate *priv = page->priv;
+	GisSystemInfo *info = gis_page_manager_get_system_info (GIS_PAGE (page)->manager);
 
-	if (g_file_get_contents ("/etc/hostname", &buffer, &len, NULL)) {
-		for (i = 0; i < len; i++) {
-			if (buffer[i] == '\n')
-				buffer[i] = '\0';
-		}
-	}
+	hostname = gis_system_info_get_hostname (info);
 
-	hostname = (buffer != NULL) ? buffer : "";
+	gtk_label_set_text (GTK_LABEL (priv->hostname_label), hostname ? hostname : "");
+}
 
-	gtk_label_set_text (GTK_LABEL (priv->hostname_label), hostname);
+/* The files are read in the background, the labels follow them */
+static void
+system_info_changed_cb (GisSystemInfo *info,
+                        gpointer       user_data)
+{
+	GisSummaryPage *page = GIS_SUMMARY_PAGE (user_data);
 
-	g_free (buffer);
+	update_distro_info (page);
+	update_hostname_info (page);
+	update_lang_info (page);
 }
 
 static void
-copy_worker_done_cb (GPid pid, gint status, gpointer user_data)
+provisioning_succeeded (GisSummaryPage *self)
 {
 	const gchar *message, *title;
 	GtkWidget *dialog, *toplevel;
 	guint res;
-	GisSummaryPage *self = GIS_SUMMARY_PAGE (user_data);
 	GisSummaryPagePrivate *priv = self->priv;
 
-	g_spawn_close_pid (pid);
-
 	/* delete /etc/lightdm/lightdm.conf.d/90_gooroom-initial-setup.conf */
 	delete_lightdm_config ();
 
+	if (gis_page_manager_get_unattended (GIS_PAGE (self)->manager)) {
+		gis_page_manager_unattended_done (GIS_PAGE (self)->manager, TRUE);
+		return;
+	}
+
 	//message = _("User's environment configuration is completed.\nRestart the system after a while...");
 	//splash_window_set_message_label (SPLASH_WINDOW (self->priv->splash), message);
 
@@ -458,81 +673,232 @@ copy_worker_done_cb (GPid pid, gint status, gpointer user_data)
 	if (res == GTK_RESPONSE_OK) {
 		const gchar *loading;
 		loading = _("Restart the system after a while...");
-		splash_window_set_message_label (SPLASH_WINDOW (self->priv->splash), loading);
+		if (priv->splash)
+			splash_window_set_message_label (SPLASH_WINDOW (priv->splash), loading);
 
 		g_timeout_add (3000, (GSourceFunc)system_restart_cb, self);
 	}
 }
 
-static gboolean
-do_copy_work (gpointer user_data)
+static void
+provisioning_done_cb (ProvisionGraph *graph,
+                      const GError   *error,
+                      gpointer        user_data)
+{
+	gint code = -1;
+	const gchar *message, *title;
+	GisSummaryPage *page = GIS_SUMMARY_PAGE (user_data);
+	GisSummaryPagePrivate *priv = page->priv;
+
+	if (error) {
+		g_warning ("Provisioning failed: %s", error->message);
+		code = (error->domain == GIS_SUMMARY_ERROR) ? error->code : ENV_CONFIGURATION_ERROR;
+	}
+
+	/* @error belongs to the graph */
+	provision_graph_free (priv->graph);
+	priv->graph = NULL;
+
+	if (code < 0) {
+		provision_journal_clear (priv->journal);
+		provisioning_succeeded (page);
+		return;
+	}
+
+	hide_splash_window (page);
+
+	switch (code) {
+		case ACCOUNT_CREATING_ERROR:
+			title = _("Account Creating Error");
+			message = _("Failed to create an account. Do you want to try again?");
+		break;
+
+		case PASSWORD_SETTING_ERROR:
+			title = _("Password Setting Error");
+			message = _("Failed to set password. Do you want to try again?");
+		break;
+
+		default:
+			title = _("User Environment Configuration Error");
+			message = _("Failed to configure user's environment. Do you want to try again?");
+		break;
+	}
+
+	show_error_dialog (page, code, title, message);
+}
+
+static void
+copy_worker_done_cb (GPid pid, gint status, gpointer user_data)
+{
+	GError *error = NULL;
+
+	g_spawn_close_pid (pid);
+
+	if (!g_spawn_check_exit_status (status, &error)) {
+		g_warning ("Failed to copy the user environment: %s", error->message);
+		provision_task_done (user_data, g_error_new (GIS_SUMMARY_ERROR, ENV_CONFIGURATION_ERROR,
+                                                     "%s", error->message));
+		g_error_free (error);
+		return;
+	}
+
+	provision_task_done (user_data, NULL);
+}
+
+static void
+copy_task (ProvisionTask *task, gpointer user_data)
 {
 	GPid pid;
-	gchar **argv;
-	gchar *cmd = NULL, *username = NULL;
-	GisSummaryPage *self = GIS_SUMMARY_PAGE (user_data);
-	GisSummaryPagePrivate *priv = self->priv;
+	gchar *username = NULL;
+	GError *error = NULL;
+	const gchar *argv[] = { "/usr/bin/pkexec", GIS_COPY_WORKER, "-u", NULL, NULL };
 	GisPageManager *manager = GIS_PAGE (user_data)->manager;
 
 	gis_page_manager_get_user_info (manager, NULL, &username, NULL);
 
-	cmd = g_strdup_printf ("/usr/bin/pkexec %s -u '%s'", GIS_COPY_WORKER, username);
+	argv[3] = username;
 
-	g_shell_parse_argv (cmd, NULL, &argv, NULL);
-
-	if (g_spawn_async (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL)) {
-		g_child_watch_add (pid, (GChildWatchFunc)copy_worker_done_cb, self);
+	if (g_spawn_async (NULL, (gchar **) argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, &error)) {
+		g_child_watch_add (pid, (GChildWatchFunc)copy_worker_done_cb, task);
+	} else {
+		g_warning ("Failed to run %s: %s", GIS_COPY_WORKER, error->message);
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, ENV_CONFIGURATION_ERROR,
+                                                "%s", error->message));
+		g_error_free (error);
 	}
 
-	g_free (cmd);
 	g_free (username);
-	g_strfreev (argv);
-
-	return FALSE;
 }
 
 static void
-su_auth_cb (SuHandler *handler,
-            GError    *error,
-            gpointer   user_data)
+keyring_password_updated_cb (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
 {
-	GisSummaryPage *page = GIS_SUMMARY_PAGE (user_data);
+	GError *error = NULL;
+	ProvisionTask *task = user_data;
+	GisSummaryPage *page = provision_task_get_user_data (task);
+	GisPageManager *manager = GIS_PAGE (page)->manager;
 
-	if (!error) {
-		g_idle_add ((GSourceFunc)do_copy_work, page);
-	} else {
-		g_warning ("failed to switch user: %s", error->message);
+	if (!gis_update_login_keyring_password_finish (res, &error)) {
+		g_warning ("Failed to change keyring password: %s", error->message);
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, ENV_CONFIGURATION_ERROR,
+                                                "%s", error->message));
 		g_error_free (error);
+		return;
+	}
+
+	clear_password (&page->priv->keyring_password);
+	gis_page_manager_get_user_info (manager, NULL, NULL, &page->priv->keyring_password);
 
-		hide_splash_window (page);
+	provision_task_done (task, NULL);
+}
 
-		const gchar *message, *title;
+static void
+change_keyring_password (ProvisionTask *task)
+{
+	gchar *password = NULL;
+	GisPageManager *manager = GIS_PAGE (provision_task_get_user_data (task))->manager;
 
-		title = _("User Environment Configuration Error");
-		message = _("Failed to configure user's environment. Do you want to try again after rebooting the system?");
+	gis_page_manager_get_user_info (manager, NULL, NULL, &password);
 
-		show_error_dialog (page, ENV_CONFIGURATION_ERROR, title, message);
-	}
+	gis_update_login_keyring_password_async (NULL, password, NULL,
+                                             keyring_password_updated_cb, task);
+
+	clear_password (&password);
 }
 
-static gboolean
-run_su_cb (gpointer user_data)
+static void
+keyring_reset_cb (GObject      *source_object,
+                  GAsyncResult *res,
+                  gpointer      user_data)
 {
-	SuHandler *su_handler = NULL;
-	gchar *username = NULL, *password = NULL;
+	GError *error = NULL;
+	ProvisionTask *task = user_data;
+	GisSummaryPage *page = provision_task_get_user_data (task);
+
+	if (!gis_reset_login_keyring_finish (res, &error)) {
+		g_warning ("Failed to reset the login keyring: %s", error->message);
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, ENV_CONFIGURATION_ERROR,
+                                                "%s", error->message));
+		g_error_free (error);
+		return;
+	}
 
+	page->priv->reset_keyring = FALSE;
+
+	change_keyring_password (task);
+}
+
+/* Only needs the new password, so it overlaps with everything
+ * up to the copy, which moves the login keyring. A keyring changed to
+ * another password has been rolled back before, see
+ * start_provisioning(), so it has the setup password again. */
+static void
+keyring_task (ProvisionTask *task, gpointer user_data)
+{
+	gchar *password = NULL;
 	GisSummaryPage *page = GIS_SUMMARY_PAGE (user_data);
+	GisSummaryPagePrivate *priv = page->priv;
 	GisPageManager *manager = GIS_PAGE (page)->manager;
 
+	gis_page_manager_get_user_info (manager, NULL, NULL, &password);
+
+	if (!password || provision_journal_password_matches (priv->journal, "keyring"))
+		provision_task_done (task, NULL);
+	else if (priv->reset_keyring)
+		gis_reset_login_keyring_async (NULL, keyring_reset_cb, task);
+	else
+		change_keyring_password (task);
+
+	clear_password (&password);
+}
+
+static void
+su_session_opened_cb (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+	SuResult result;
+	GError *error = NULL;
+	ProvisionTask *task = user_data;
+
+	if (su_open_session_finish (res, &result, &error)) {
+		g_debug ("PAM session for the new user: authenticate %.1f ms, "
+                 "open %.1f ms, close %.1f ms, total %.1f ms",
+                 result.authenticate_time / 1000.0,
+                 result.open_session_time / 1000.0,
+                 result.close_session_time / 1000.0,
+                 result.total_time / 1000.0);
+
+		provision_task_done (task, NULL);
+	} else {
+		g_warning ("failed to switch user: %s (PAM status %d, %.1f ms)",
+                   error->message, result.pam_status, result.total_time / 1000.0);
+
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, ENV_CONFIGURATION_ERROR,
+                                                "%s", error->message));
+		g_error_free (error);
+	}
+}
+
+/* Mounts and initializes the encrypted home through pam_ecryptfs,
+ * which unwraps the passphrase with the login password. */
+static void
+session_task (ProvisionTask *task, gpointer user_data)
+{
+	gchar *username = NULL, *password = NULL;
+	GisPageManager *manager = GIS_PAGE (user_data)->manager;
+
 	gis_page_manager_get_user_info (manager, NULL, &username, &password);
 
-	su_handler = su_init ();
-	su_authenticate (su_handler, username, password, (SuCallback)su_auth_cb, page);
+	su_open_session_async (username, password, NULL, su_session_opened_cb, task);
+
+	if (password)
+		memset (password, 0, strlen (password));
 
 	g_free (username);
 	g_free (password);
-
-	return FALSE;
 }
 
 static void
@@ -540,153 +906,408 @@ password_changed_done_cb (PasswdHandler *handler,
                           GError        *error,
                           gpointer       user_data)
 {
-	GisSummaryPage *page = GIS_SUMMARY_PAGE (user_data);
-	GisPageManager *manager = GIS_PAGE (page)->manager;
+	ProvisionTask *task = user_data;
 
 	if (!error) {
-		gchar *password = NULL;
-		gis_page_manager_get_user_info (manager, NULL, NULL, &password);
-		if (password)
-			gis_update_login_keyring_password (password);
+		provision_task_done (task, NULL);
+	} else {
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, PASSWORD_SETTING_ERROR,
+                                                "%s", error->message));
+	}
+}
+
+static void
+passwd_task (ProvisionTask *task, gpointer user_data)
+{
+	gchar *username = NULL, *password = NULL;
+	GisSummaryPage *page = GIS_SUMMARY_PAGE (user_data);
+	GisSummaryPagePrivate *priv = page->priv;
+	GisPageManager *manager = GIS_PAGE (page)->manager;
 
-		g_timeout_add (1000, (GSourceFunc)run_su_cb, page);
+	gis_page_manager_get_user_info (manager, NULL, &username, &password);
 
-		g_free (password);
-	} else {
-		g_warning ("failed to run su: %s", error->message);
-		g_error_free (error);
+	if (!priv->passwd_handler)
+		priv->passwd_handler = passwd_init ();
 
-		hide_splash_window (page);
+	if (!passwd_change_password (priv->passwd_handler, username, password,
+                                 (PasswdCallback) password_changed_done_cb, task)) {
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, PASSWORD_SETTING_ERROR,
+                                                "Failed to run passwd"));
+	}
 
-		const gchar *message, *title;
+	g_free (username);
+	g_free (password);
+}
 
-		title = _("Password Setting Error");
-		message = _("Failed to set password. Do you want to try again after rebooting the system?");
+static void
+usermod_done_cb (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+	GError *error = NULL;
 
-		show_error_dialog (page, PASSWORD_SETTING_ERROR, title, message);
+	if (!g_subprocess_wait_check_finish (G_SUBPROCESS (source_object), res, &error)) {
+		g_warning ("Failed to add the user to the groups: %s", error->message);
+		provision_task_done (user_data, g_error_new (GIS_SUMMARY_ERROR, ENV_CONFIGURATION_ERROR,
+                                                     "%s", error->message));
+		g_error_free (error);
+		return;
 	}
+
+	provision_task_done (user_data, NULL);
 }
 
+/* One usermod call for all groups; unknown groups would make it fail
+ * as a whole, so they are left out. */
 static void
-add_user_group (GisSummaryPage *page)
+groups_task (ProvisionTask *task, gpointer user_data)
 {
 	guint i = 0;
-	gchar *cmd = NULL;
-	gchar *username = NULL, *realname = NULL;
-	GisSummaryPagePrivate *priv = page->priv;
-	GisPageManager *manager = GIS_PAGE (page)->manager;
+	gchar *username = NULL;
+	const gchar * const *modes;
+	GString *groups;
+	GSubprocess *subprocess;
+	GError *error = NULL;
+	GisPageManager *manager = GIS_PAGE (user_data)->manager;
 
-	static char *modes[] = { "adm", "audio", "bluetooth", "cdrom", "dialout",
+	static const char * const default_modes[] = { "adm", "audio", "bluetooth", "cdrom", "dialout",
 				 "dip", "fax", "floppy", "lpadmin", "netdev", "plugdev",
 				 "scanner", "sudo", "tape", "users",  "video", NULL };
 
-	gis_page_manager_get_user_info (manager, &realname, &username, NULL);
+	gis_page_manager_get_user_info (manager, NULL, &username, NULL);
 
-	for (i = 0; modes[i] != NULL; i++) {
-		cmd = g_strdup_printf ("/usr/bin/pkexec /usr/sbin/usermod -aG %s %s",modes[i], username);
+	modes = gis_page_manager_get_groups (manager);
+	if (!modes)
+		modes = default_modes;
 
-		if (!g_spawn_command_line_sync (cmd, NULL, NULL, NULL, NULL)){
-			g_warning ("Faild to register %s with group [ #%d: %s ]\n", username, i, modes[i]);
+	groups = g_string_new (NULL);
+	for (i = 0; modes[i] != NULL; i++) {
+		if (getgrnam (modes[i]) == NULL) {
+			g_warning ("Faild to register %s with group [ #%d: %s ]: no such group", username, i, modes[i]);
+			continue;
 		}
+		if (groups->len > 0)
+			g_string_append_c (groups, ',');
+		g_string_append (groups, modes[i]);
 	}
-	g_free (cmd);
+
+	if (groups->len == 0) {
+		provision_task_done (task, NULL);
+		goto out;
+	}
+
+	subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_SILENCE | G_SUBPROCESS_FLAGS_STDERR_SILENCE,
+                                   &error,
+                                   "/usr/bin/pkexec", "/usr/sbin/usermod", "-aG", groups->str, username, NULL);
+	if (subprocess) {
+		g_subprocess_wait_check_async (subprocess, NULL, usermod_done_cb, task);
+		g_object_unref (subprocess);
+	} else {
+		g_warning ("Failed to run usermod: %s", error->message);
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, ENV_CONFIGURATION_ERROR,
+                                                "%s", error->message));
+		g_error_free (error);
+	}
+
+out:
+	g_string_free (groups, TRUE);
+	g_free (username);
 }
 
 static void
-adduser_done_cb (GPid pid, gint status, gpointer user_data)
+adduser_done_cb (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
 {
-	PasswdHandler  *passwd_handler = NULL;
-	gchar *username = NULL, *password = NULL;
-	GisSummaryPage *page = GIS_SUMMARY_PAGE (user_data);
-	GisSummaryPagePrivate *priv = page->priv;
+	gchar *username = NULL;
+	ProvisionTask *task = user_data;
+	GisSummaryPage *page = GIS_SUMMARY_PAGE (provision_task_get_user_data (task));
 	GisPageManager *manager = GIS_PAGE (page)->manager;
 
-	g_spawn_close_pid (pid);
+	g_subprocess_wait_finish (G_SUBPROCESS (source_object), res, NULL);
 
-	gis_page_manager_get_user_info (manager, NULL, &username, &password);
+	gis_page_manager_get_user_info (manager, NULL, &username, NULL);
 
 	if (is_valid_username (username)) {
-		g_usleep (G_USEC_PER_SEC); // waiting for 1 secs
+		provision_task_done (task, NULL);
+	} else {
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, ACCOUNT_CREATING_ERROR,
+                                                "adduser did not create %s", username));
+	}
+
+	g_free (username);
+}
 
-		passwd_handler = passwd_init ();
-		passwd_change_password (passwd_handler, username, password,
-				(PasswdCallback) password_changed_done_cb, page);
+/* What adduser prints when it starts a stage, and how far along the
+ * account is by then. Setting up the encryption takes longest. Lines
+ * that match none of them, such as those of ecryptfs-setup-private,
+ * leave the progress where it is. */
+static const struct {
+	const gchar *message;
+	gdouble fraction;
+} adduser_stages[] = {
+	{ "Adding new group", 0.1 },
+	{ "Adding new user", 0.2 },
+	{ "Creating home directory", 0.3 },
+	{ "Setting up encryption", 0.4 },
+	{ "Copying files from", 0.9 }
+};
 
-		g_timeout_add (3000, (GSourceFunc)add_user_group, page);
-	} else {
-		const gchar *message, *title;
+static void
+adduser_output_cb (GObject      *source_object,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+	guint i;
+	gchar *line;
+	ProvisionTask *task = user_data;
+	GDataInputStream *stream = G_DATA_INPUT_STREAM (source_object);
+	GSubprocess *subprocess = g_object_get_data (G_OBJECT (stream), "subprocess");
+
+	line = g_data_input_stream_read_line_finish (stream, res, NULL, NULL);
+	if (line == NULL) {
+		/* end of output, adduser is exiting */
+		g_subprocess_wait_async (subprocess, NULL, adduser_done_cb, task);
+		g_object_unref (stream);
+		return;
+	}
+
+	g_debug ("adduser: %s", line);
+
+	for (i = 0; i < G_N_ELEMENTS (adduser_stages); i++) {
+		if (strstr (line, adduser_stages[i].message)) {
+			provision_task_progress (task, adduser_stages[i].fraction);
+			break;
+		}
+	}
+
+	g_free (line);
 
-		title = _("Account Creating Error");
-		message = _("Failed to create an account. Do you want to try again after rebooting the system?");
+	g_data_input_stream_read_line_async (stream, G_PRIORITY_DEFAULT, NULL, adduser_output_cb, task);
+}
+
+static void
+spawn_adduser (ProvisionTask *task)
+{
+	GError *error = NULL;
+	GSubprocess *subprocess;
+	GSubprocessLauncher *launcher;
+	GDataInputStream *stream;
+	gchar *gecos = NULL, *realname = NULL, *username = NULL;
+	GisPageManager *manager = GIS_PAGE (provision_task_get_user_data (task))->manager;
 
-		hide_splash_window (page);
+	gis_page_manager_get_user_info (manager, &realname, &username, NULL);
 
-		show_error_dialog (page, ACCOUNT_CREATING_ERROR, title, message);
+	if (realname)
+		gecos = g_locale_to_utf8 (realname, -1, NULL, NULL, NULL);
+	if (!gecos)
+		gecos = g_strdup (username);
+
+	/* untranslated messages, so the stages can be told apart */
+	launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_SILENCE);
+	g_subprocess_launcher_unsetenv (launcher, "LC_ALL");
+	g_subprocess_launcher_setenv (launcher, "LC_MESSAGES", "C", TRUE);
+
+	/* every value is a single argument; nothing goes through a shell */
+	subprocess = g_subprocess_launcher_spawn (launcher, &error,
+                                              "/usr/bin/pkexec", "/usr/sbin/adduser",
+                                              "--force-badname", "--shell", "/bin/bash",
+                                              "--disabled-login", "--encrypt-home",
+                                              "--gecos", gecos, "--", username, NULL);
+	g_object_unref (launcher);
+
+	if (subprocess) {
+		stream = g_data_input_stream_new (g_subprocess_get_stdout_pipe (subprocess));
+		g_object_set_data_full (G_OBJECT (stream), "subprocess", subprocess, g_object_unref);
+		g_data_input_stream_read_line_async (stream, G_PRIORITY_DEFAULT, NULL, adduser_output_cb, task);
+	} else {
+		provision_task_done (task, g_error_new (GIS_SUMMARY_ERROR, ACCOUNT_CREATING_ERROR,
+                                                "Failed to run adduser: %s", error->message));
+		g_error_free (error);
 	}
 
+	g_free (gecos);
+	g_free (realname);
 	g_free (username);
-	g_free (password);
+}
 
-#if 0
-	gint exit_status = WEXITSTATUS (status);
+static void
+leftovers_removed_cb (GObject      *source_object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+	GError *error = NULL;
+
+	/* the helper also refuses a name that was in use before the setup
+	 * ran, which adduser must not get either */
+	if (!remove_home_finish (res, &error)) {
+		g_warning ("Couldn't remove leftovers of an earlier account: %s", error->message);
+		provision_task_done (user_data, g_error_new (GIS_SUMMARY_ERROR, ACCOUNT_CREATING_ERROR,
+                                                     "%s", error->message));
+		g_error_free (error);
+		return;
+	}
 
-	switch (exit_status)
-	{
-		case 1:
-		break;
+	spawn_adduser (user_data);
+}
 
-		case 2:
-		break;
+/* Creates the account, populates the home from /etc/skel and sets up
+ * the wrapped ecryptfs passphrase, after clearing what an earlier
+ * account of the same name may have left */
+static void
+adduser_task (ProvisionTask *task, gpointer user_data)
+{
+	gchar *username = NULL;
+	GisPageManager *manager = GIS_PAGE (user_data)->manager;
 
-		case 3:
-		break;
+	gis_page_manager_get_user_info (manager, NULL, &username, NULL);
 
-		default:
-		break;
-	}
-#endif
+	remove_home_async (username, TRUE, leftovers_removed_cb, task);
+
+	g_free (username);
 }
 
 static void
-gis_summary_page_save_data (GisPage *page)
+provision_event_cb (const ProvisionEvent *event,
+                    gpointer              user_data)
 {
-	GPid pid;
-	gchar **argv;
-	const char *cmd_prefix;
-	gchar *cmd = NULL, *realname = NULL, *username = NULL;
-	GisSummaryPage *self = GIS_SUMMARY_PAGE (page);
-	GisSummaryPagePrivate *priv = self->priv;
-	GisPageManager *manager = page->manager;
+	GisSummaryPagePrivate *priv = GIS_SUMMARY_PAGE (user_data)->priv;
 
-	splash_window_show (priv->splash);
+	if (priv->splash)
+		splash_window_push_event (priv->splash, event);
+}
 
-	gis_page_manager_get_user_info (manager, &realname, &username, NULL);
+/*
+ * adduser ──┬── passwd ── session ──┬── copy
+ *           └── groups              │
+ * keyring ──────────────────────────┘
+ */
+static void
+run_provisioning (GisSummaryPage *page)
+{
+	guint i;
+	gchar *log_file, *username = NULL, *password = NULL;
+	GError *error = NULL;
+	ProvisionTask *tasks[6];
+	ProvisionStepState state;
+	GisSummaryPagePrivate *priv = page->priv;
+	GisPageManager *manager = GIS_PAGE (page)->manager;
 
+	static const struct {
+		const gchar *name;
+		const gchar *title;
+	} steps[] = {
+		{ "adduser", N_("Creating the account") },
+		{ "passwd",  N_("Setting the password") },
+		{ "groups",  N_("Adding the user to groups") },
+		{ "keyring", N_("Updating the keyring") },
+		{ "session", N_("Setting up the home folder") },
+		{ "copy",    N_("Copying the settings") },
+	};
 
-	cmd_prefix = "/usr/bin/pkexec /usr/sbin/adduser --force-badname --shell /bin/bash --disabled-login --encrypt-home --gecos";
+	g_return_if_fail (priv->graph == NULL);
 
-	if (!realname)
-		realname = g_strdup (username);
+	priv->starting = FALSE;
 
-	if (realname) {
-		char *utf8_realname = g_locale_to_utf8 (realname, -1, NULL, NULL, NULL);
-		cmd = g_strdup_printf ("%s \"%s\" %s", cmd_prefix, utf8_realname, username);
-		g_free (utf8_realname);
-	} else {
-		cmd = g_strdup_printf ("%s \"%s\" %s", cmd_prefix, username, username);
-	}
+	gis_page_manager_get_user_info (manager, NULL, &username, &password);
 
-	remove_after_checking_file_exists (self, username);
-	g_shell_parse_argv (cmd, NULL, &argv, NULL);
+	provision_journal_set_user (priv->journal, username);
+	provision_journal_set_password (priv->journal, password);
+	g_free (username);
+	clear_password (&password);
 
-	if (g_spawn_async (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL)) {
-		g_child_watch_add (pid, (GChildWatchFunc) adduser_done_cb, self);
+	priv->graph = provision_graph_new (provisioning_done_cb, page);
+
+	log_file = g_build_filename (g_get_user_cache_dir (), "gooroom-initial-setup", "provisioning.log", NULL);
+	if (!provision_graph_log_to_file (priv->graph, log_file, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
 	}
+	g_free (log_file);
 
-	g_free (cmd);
-	g_free (realname);
+	if (priv->splash) {
+		for (i = 0; i < G_N_ELEMENTS (steps); i++)
+			splash_window_add_step (priv->splash, steps[i].name, _(steps[i].title));
+		splash_window_show (priv->splash);
+	}
+	provision_graph_add_listener (priv->graph, provision_event_cb, page);
+	provision_graph_add_listener (priv->graph, provision_journal_event, priv->journal);
+
+	tasks[0] = provision_graph_add_task (priv->graph, "adduser", adduser_task, page, NULL);
+	tasks[1] = provision_graph_add_task (priv->graph, "keyring", keyring_task, page, NULL);
+	tasks[2] = provision_graph_add_task (priv->graph, "passwd", passwd_task, page, tasks[0], NULL);
+	tasks[3] = provision_graph_add_task (priv->graph, "groups", groups_task, page, tasks[0], NULL);
+	tasks[4] = provision_graph_add_task (priv->graph, "session", session_task, page, tasks[2], NULL);
+	tasks[5] = provision_graph_add_task (priv->graph, "copy", copy_task, page, tasks[4], tasks[1], NULL);
+
+	/* known only before the graph marks the step as started again */
+	state = provision_journal_get_state (priv->journal, "keyring");
+	priv->reset_keyring = ((state == PROVISION_STEP_STARTED || state == PROVISION_STEP_FAILED) &&
+                           !provision_journal_password_matches (priv->journal, "keyring"));
+
+	for (i = 0; i < G_N_ELEMENTS (tasks); i++) {
+		const gchar *name = provision_task_get_name (tasks[i]);
+		if (provision_journal_get_state (priv->journal, name) == PROVISION_STEP_DONE &&
+            !provision_journal_password_changed (priv->journal, name))
+			provision_task_set_done (tasks[i]);
+	}
+
+	provision_graph_run (priv->graph);
+}
+
+static void
+rolled_back_cb (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+	run_provisioning (GIS_SUMMARY_PAGE (source_object));
+}
+
+static void
+start_provisioning (GisSummaryPage *page)
+{
+	gchar *journal_user, *username = NULL, *password = NULL;
+	GisSummaryPagePrivate *priv = page->priv;
+	GisPageManager *manager = GIS_PAGE (page)->manager;
+
+	if (priv->graph || priv->starting)
+		return;
+
+	priv->starting = TRUE;
+
+	if (!priv->splash && !gis_page_manager_get_unattended (manager))
+		show_splash_window (page);
+	if (priv->splash)
+		splash_window_show (priv->splash);
+
+	gis_page_manager_get_user_info (manager, NULL, &username, &password);
+	provision_journal_set_password (priv->journal, password);
+	clear_password (&password);
+
+	/* a run for another user, one whose account or keyring got another
+	 * password, or one that broke off while creating the account is
+	 * undone first; anything else is resumed */
+	journal_user = provision_journal_dup_user (priv->journal);
+	if (journal_user &&
+        (g_strcmp0 (journal_user, username) != 0 ||
+         provision_journal_get_state (priv->journal, "adduser") != PROVISION_STEP_DONE ||
+         provision_journal_password_changed (priv->journal, "passwd") ||
+         provision_journal_password_changed (priv->journal, "keyring") ||
+         !is_valid_username (username)))
+		rollback_provisioning_async (page, rolled_back_cb, NULL);
+	else
+		run_provisioning (page);
+
+	g_free (journal_user);
 	g_free (username);
-	g_strfreev (argv);
+}
+
+static void
+gis_summary_page_save_data (GisPage *page)
+{
+	GisSummaryPage *self = GIS_SUMMARY_PAGE (page);
+
+	start_provisioning (self);
 }
 
 static void
@@ -704,6 +1325,15 @@ gis_summary_page_shown (GisPage *page)
 static void
 gis_summary_page_finalize (GObject *object)
 {
+	GisSummaryPagePrivate *priv = GIS_SUMMARY_PAGE (object)->priv;
+
+	if (priv->passwd_handler)
+		passwd_destroy (priv->passwd_handler);
+
+	provision_graph_free (priv->graph);
+	provision_journal_free (priv->journal);
+	clear_password (&priv->keyring_password);
+
 	G_OBJECT_CLASS (gis_summary_page_parent_class)->finalize (object);
 }
 
@@ -717,6 +1347,12 @@ gis_summary_page_constructed (GObject *object)
 
 	gis_page_set_complete (GIS_PAGE (page), TRUE);
 
+	g_signal_connect_object (gis_page_manager_get_system_info (GIS_PAGE (page)->manager),
+                             "changed", G_CALLBACK (system_info_changed_cb), page, 0);
+
+	if (!gis_page_manager_get_unattended (GIS_PAGE (page)->manager))
+		show_splash_window (page);
+
 	gtk_widget_show (GTK_WIDGET (page));
 }
 
@@ -739,17 +1375,20 @@ gis_summary_page_locale_changed (GisPage *page)
 static void
 gis_summary_page_init (GisSummaryPage *page)
 {
+	gchar *journal_file;
 	GisSummaryPagePrivate *priv;
 
 	priv = page->priv = gis_summary_page_get_instance_private (page);
 
-	g_resources_register (summary_get_resource ());
-
 	gtk_widget_init_template (GTK_WIDGET (page));
 
-	gis_page_set_title (GIS_PAGE (page), _("Setup Complete"));
+	gis_image_set_from_name (GTK_IMAGE (priv->success_image), "success-image", 180, 90);
+
+	journal_file = get_journal_filename ();
+	priv->journal = provision_journal_load (journal_file);
+	g_free (journal_file);
 
-	show_splash_window (page);
+	gis_page_set_title (GIS_PAGE (page), _("Setup Complete"));
 }
 
 static void
@@ -762,6 +1401,7 @@ gis_summary_page_class_init (GisSummaryPageClass *klass)
 			"/kr/gooroom/initial-setup/pages/summary/gis-summary-page.ui");
 
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisSummaryPage, setup_done_label);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisSummaryPage, success_image);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisSummaryPage, os_label);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisSummaryPage, os_text_label);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass), GisSummaryPage, hostname_text_label);
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Provisioning steps and the steps they wait for. Every task whose
+ * dependencies have finished is started right away, so independent
+ * steps overlap and the whole run takes as long as its longest chain.
+ * After a failure nothing new is started; the graph completes once the
+ * tasks already running have reported back.
+ *
+ * Every state change is also sent to the listeners as a
+ * ProvisionEvent, which drives the splash window and the log file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdarg.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "provision-graph.h"
+
+typedef enum {
+	TASK_PENDING,
+	TASK_RUNNING,
+	TASK_DONE,
+	TASK_FAILED
+} TaskState;
+
+struct _ProvisionTask {
+	ProvisionGraph    *graph;
+	gchar             *name;
+	ProvisionTaskFunc  func;
+	gpointer           user_data;
+	GPtrArray         *deps;
+	TaskState          state;
+	guint              index;
+	gint64             start_time;
+};
+
+typedef struct {
+	ProvisionEventFunc func;
+	gpointer           user_data;
+} Listener;
+
+struct _ProvisionGraph {
+	GPtrArray              *tasks;
+	ProvisionGraphCallback  callback;
+	gpointer                user_data;
+
+	GError                 *error;
+	guint                   n_running;
+	gint64                  start_time;
+
+	GArray                 *listeners;
+	FILE                   *log;
+
+	gboolean                scheduling;
+	gboolean                reschedule;
+	gboolean                finished;
+};
+
+
+static void
+provision_task_free (gpointer data)
+{
+	ProvisionTask *task = data;
+
+	g_ptr_array_unref (task->deps);
+	g_free (task->name);
+	g_free (task);
+}
+
+ProvisionGraph *
+provision_graph_new (ProvisionGraphCallback callback,
+                     gpointer               user_data)
+{
+	ProvisionGraph *graph;
+
+	graph = g_new0 (ProvisionGraph, 1);
+	graph->tasks = g_ptr_array_new_with_free_func (provision_task_free);
+	graph->listeners = g_array_new (FALSE, FALSE, sizeof (Listener));
+	graph->callback = callback;
+	graph->user_data = user_data;
+
+	return graph;
+}
+
+void
+provision_graph_free (ProvisionGraph *graph)
+{
+	if (graph == NULL)
+		return;
+
+	g_ptr_array_unref (graph->tasks);
+	g_array_unref (graph->listeners);
+	g_clear_error (&graph->error);
+
+	if (graph->log)
+		fclose (graph->log);
+	g_free (graph);
+}
+
+/* The trailing arguments are the tasks this one waits for, ended by NULL */
+ProvisionTask *
+provision_graph_add_task (ProvisionGraph    *graph,
+                          const gchar       *name,
+                          ProvisionTaskFunc  func,
+                          gpointer           user_data,
+                          ...)
+{
+	va_list ap;
+	ProvisionTask *task, *dep;
+
+	task = g_new0 (ProvisionTask, 1);
+	task->graph = graph;
+	task->name = g_strdup (name);
+	task->func = func;
+	task->user_data = user_data;
+	task->deps = g_ptr_array_new ();
+	task->state = TASK_PENDING;
+	task->index = graph->tasks->len;
+
+	va_start (ap, user_data);
+	while ((dep = va_arg (ap, ProvisionTask *)) != NULL)
+		g_ptr_array_add (task->deps, dep);
+	va_end (ap);
+
+	g_ptr_array_add (graph->tasks, task);
+
+	return task;
+}
+
+static gboolean
+task_is_ready (ProvisionTask *task)
+{
+	guint i;
+
+	for (i = 0; i < task->deps->len; i++) {
+		ProvisionTask *dep = g_ptr_array_index (task->deps, i);
+		if (dep->state != TASK_DONE)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+emit_event (ProvisionTask      *task,
+            ProvisionEventType  type,
+            gdouble             fraction,
+            const GError       *error)
+{
+	guint i;
+	ProvisionEvent event;
+	ProvisionGraph *graph = task->graph;
+
+	event.type = type;
+	event.task = task->name;
+	event.index = task->index;
+	event.n_tasks = graph->tasks->len;
+	event.fraction = CLAMP (fraction, 0.0, 1.0);
+	event.elapsed = g_get_monotonic_time () - task->start_time;
+	event.timestamp = g_get_real_time ();
+	event.error = error;
+
+	for (i = 0; i < graph->listeners->len; i++) {
+		Listener *listener = &g_array_index (graph->listeners, Listener, i);
+		listener->func (&event, listener->user_data);
+	}
+}
+
+static void
+schedule (ProvisionGraph *graph)
+{
+	guint i;
+	gboolean pending = FALSE;
+
+	/* a task may finish from within its own func */
+	if (graph->scheduling) {
+		graph->reschedule = TRUE;
+		return;
+	}
+
+	graph->scheduling = TRUE;
+
+	do {
+		graph->reschedule = FALSE;
+
+		for (i = 0; i < graph->tasks->len && graph->error == NULL; i++) {
+			ProvisionTask *task = g_ptr_array_index (graph->tasks, i);
+
+			if (task->state != TASK_PENDING || !task_is_ready (task))
+				continue;
+
+			task->state = TASK_RUNNING;
+			task->start_time = g_get_monotonic_time ();
+			graph->n_running++;
+
+			emit_event (task, PROVISION_EVENT_STARTED, 0.0, NULL);
+
+			task->func (task, task->user_data);
+		}
+	} while (graph->reschedule);
+
+	graph->scheduling = FALSE;
+
+	if (graph->n_running > 0 || graph->finished)
+		return;
+
+	for (i = 0; i < graph->tasks->len; i++) {
+		ProvisionTask *task = g_ptr_array_index (graph->tasks, i);
+		if (task->state == TASK_PENDING)
+			pending = TRUE;
+	}
+
+	if (pending && graph->error == NULL) {
+		g_set_error_literal (&graph->error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Provisioning tasks have unsatisfiable dependencies");
+	}
+
+	g_debug ("Provisioning: finished in %.1f ms",
+             (g_get_monotonic_time () - graph->start_time) / 1000.0);
+
+	graph->finished = TRUE;
+
+	/* the callback may free the graph */
+	if (graph->callback)
+		graph->callback (graph, graph->error, graph->user_data);
+}
+
+void
+provision_graph_add_listener (ProvisionGraph     *graph,
+                              ProvisionEventFunc  func,
+                              gpointer            user_data)
+{
+	Listener listener = { func, user_data };
+
+	g_array_append_val (graph->listeners, listener);
+}
+
+static const gchar *
+event_type_to_string (ProvisionEventType type)
+{
+	switch (type) {
+		case PROVISION_EVENT_STARTED:
+			return "started";
+		case PROVISION_EVENT_PROGRESS:
+			return "progress";
+		case PROVISION_EVENT_DONE:
+			return "done";
+		case PROVISION_EVENT_FAILED:
+			return "failed";
+		case PROVISION_EVENT_SKIPPED:
+			return "skipped";
+		default:
+			return "unknown";
+	}
+}
+
+/* One line per event:
+ * <ISO 8601 time> <task> <event> <fraction> <elapsed ms> [<error>] */
+static void
+log_event (const ProvisionEvent *event,
+           gpointer              user_data)
+{
+	gchar *time;
+	GDateTime *dt;
+	ProvisionGraph *graph = user_data;
+
+	dt = g_date_time_new_from_unix_utc (event->timestamp / G_USEC_PER_SEC);
+	time = g_date_time_format (dt, "%Y-%m-%dT%H:%M:%SZ");
+
+	fprintf (graph->log, "%s %s %s %.2f %.1f%s%s\n",
+             time,
+             event->task,
+             event_type_to_string (event->type),
+             event->fraction,
+             event->elapsed / 1000.0,
+             event->error ? " " : "",
+             event->error ? event->error->message : "");
+	fflush (graph->log);
+
+	g_free (time);
+	g_date_time_unref (dt);
+}
+
+/* Appends every event to @filename, which is created if needed */
+gboolean
+provision_graph_log_to_file (ProvisionGraph  *graph,
+                             const gchar     *filename,
+                             GError         **error)
+{
+	int saved_errno;
+	gchar *dirname;
+
+	g_return_val_if_fail (graph->log == NULL, FALSE);
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	graph->log = g_fopen (filename, "a");
+	if (graph->log == NULL) {
+		saved_errno = errno;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "Failed to open %s: %s", filename, g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	provision_graph_add_listener (graph, log_event, graph);
+
+	return TRUE;
+}
+
+void
+provision_graph_run (ProvisionGraph *graph)
+{
+	guint i;
+
+	g_return_if_fail (graph->start_time == 0);
+
+	graph->start_time = g_get_monotonic_time ();
+
+	for (i = 0; i < graph->tasks->len; i++) {
+		ProvisionTask *task = g_ptr_array_index (graph->tasks, i);
+
+		if (task->state == TASK_DONE) {
+			task->start_time = graph->start_time;
+			emit_event (task, PROVISION_EVENT_SKIPPED, 1.0, NULL);
+		}
+	}
+
+	schedule (graph);
+}
+
+/* Marks a task that an earlier run finished; it is not started again
+ * and its dependents may start right away. */
+void
+provision_task_set_done (ProvisionTask *task)
+{
+	g_return_if_fail (task->state == TASK_PENDING);
+	g_return_if_fail (task->graph->start_time == 0);
+
+	task->state = TASK_DONE;
+}
+
+/* Reports how far a long running task has got */
+void
+provision_task_progress (ProvisionTask *task,
+                         gdouble        fraction)
+{
+	g_return_if_fail (task->state == TASK_RUNNING);
+
+	emit_event (task, PROVISION_EVENT_PROGRESS, fraction, NULL);
+}
+
+/* Takes ownership of @error */
+void
+provision_task_done (ProvisionTask *task,
+                     GError        *error)
+{
+	ProvisionGraph *graph = task->graph;
+
+	g_return_if_fail (task->state == TASK_RUNNING);
+
+	graph->n_running--;
+
+	if (error)
+		emit_event (task, PROVISION_EVENT_FAILED, 1.0, error);
+	else
+		emit_event (task, PROVISION_EVENT_DONE, 1.0, NULL);
+
+	if (error) {
+		task->state = TASK_FAILED;
+		if (graph->error == NULL)
+			graph->error = error;
+		else
+			g_error_free (error);
+	} else {
+		task->state = TASK_DONE;
+	}
+
+	schedule (graph);
+}
+
+const gchar *
+provision_task_get_name (ProvisionTask *task)
+{
+	return task->name;
+}
+
+gpointer
+provision_task_get_user_data (ProvisionTask *task)
+{
+	return task->user_data;
+}
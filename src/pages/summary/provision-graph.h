@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __PROVISION_GRAPH_H__
+#define __PROVISION_GRAPH_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ProvisionGraph ProvisionGraph;
+typedef struct _ProvisionTask  ProvisionTask;
+
+/* Starts the work of @task, which reports back through
+ * provision_task_done() once it is finished. */
+typedef void (*ProvisionTaskFunc)      (ProvisionTask  *task,
+                                        gpointer        user_data);
+
+typedef enum {
+	PROVISION_EVENT_STARTED,
+	PROVISION_EVENT_PROGRESS,
+	PROVISION_EVENT_DONE,
+	PROVISION_EVENT_FAILED,
+	PROVISION_EVENT_SKIPPED,    /* finished by an earlier run */
+} ProvisionEventType;
+
+/* Everything here is only valid during the listener call */
+typedef struct {
+	ProvisionEventType  type;
+	const gchar        *task;       /* name of the task */
+	guint               index;      /* order in which the task was added */
+	guint               n_tasks;
+	gdouble             fraction;   /* progress of the task, 0 to 1 */
+	gint64              elapsed;    /* time since the task started, usec */
+	gint64              timestamp;  /* real time of the event, usec */
+	const GError       *error;      /* set for PROVISION_EVENT_FAILED */
+} ProvisionEvent;
+
+typedef void (*ProvisionEventFunc)     (const ProvisionEvent *event,
+                                        gpointer              user_data);
+
+/* Called once nothing is running any more; @error is the first
+ * failure, or NULL when every task succeeded. */
+typedef void (*ProvisionGraphCallback) (ProvisionGraph *graph,
+                                        const GError   *error,
+                                        gpointer        user_data);
+
+
+ProvisionGraph *provision_graph_new       (ProvisionGraphCallback  callback,
+                                           gpointer                user_data);
+void            provision_graph_free      (ProvisionGraph         *graph);
+
+ProvisionTask  *provision_graph_add_task  (ProvisionGraph         *graph,
+                                           const gchar            *name,
+                                           ProvisionTaskFunc       func,
+                                           gpointer                user_data,
+                                           ...) G_GNUC_NULL_TERMINATED;
+
+void            provision_graph_add_listener (ProvisionGraph      *graph,
+                                              ProvisionEventFunc   func,
+                                              gpointer             user_data);
+gboolean        provision_graph_log_to_file  (ProvisionGraph      *graph,
+                                              const gchar         *filename,
+                                              GError             **error);
+
+void            provision_graph_run       (ProvisionGraph         *graph);
+
+void            provision_task_set_done   (ProvisionTask          *task);
+void            provision_task_progress   (ProvisionTask          *task,
+                                           gdouble                 fraction);
+void            provision_task_done       (ProvisionTask          *task,
+                                           GError                 *error);
+const gchar    *provision_task_get_name   (ProvisionTask          *task);
+gpointer        provision_task_get_user_data (ProvisionTask     *task);
+
+G_END_DECLS
+
+#endif /* __PROVISION_GRAPH_H__ */
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Records which provisioning steps were started and finished for which
+ * user, so that a later run can skip finished steps and undo exactly
+ * what an abandoned run left behind:
+ *
+ *   [Provisioning]
+ *   User=<user name>
+ *
+ *   Salt=<random hex string>
+ *
+ *   [Steps]
+ *   adduser=done
+ *   passwd=started
+ *
+ *   [Passwords]
+ *   adduser=<HMAC-SHA256 of the password, keyed with the salt>
+ *
+ * A finished step remembers which password it was done with, so a run
+ * with another password knows what it has to redo. Starting or failing
+ * the step again keeps the digest, the earlier work is still in place.
+ * The digest tells no more than the login keyring next to it, which is
+ * encrypted with the same password.
+ *
+ * The file is rewritten atomically after every change.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "provision-journal.h"
+
+#define GROUP_PROVISIONING "Provisioning"
+#define GROUP_STEPS        "Steps"
+#define GROUP_PASSWORDS    "Passwords"
+
+#define SALT_LENGTH 16
+
+struct _ProvisionJournal {
+	gchar    *filename;
+	GKeyFile *keyfile;
+	gchar    *digest;       /* of the password of the current run */
+};
+
+static const gchar * const state_names[] = {
+	"none", "started", "failed", "done"
+};
+
+
+static void
+provision_journal_save (ProvisionJournal *journal)
+{
+	gchar *dirname;
+	GError *error = NULL;
+
+	dirname = g_path_get_dirname (journal->filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	if (!g_key_file_save_to_file (journal->keyfile, journal->filename, &error)) {
+		g_warning ("Failed to write %s: %s", journal->filename, error->message);
+		g_error_free (error);
+	}
+}
+
+/* A missing or unreadable file gives an empty journal */
+ProvisionJournal *
+provision_journal_load (const gchar *filename)
+{
+	GError *error = NULL;
+	ProvisionJournal *journal;
+
+	journal = g_new0 (ProvisionJournal, 1);
+	journal->filename = g_strdup (filename);
+	journal->keyfile = g_key_file_new ();
+
+	if (!g_key_file_load_from_file (journal->keyfile, filename, G_KEY_FILE_NONE, &error)) {
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_warning ("Ignoring %s: %s", filename, error->message);
+		g_error_free (error);
+	}
+
+	return journal;
+}
+
+void
+provision_journal_free (ProvisionJournal *journal)
+{
+	if (journal == NULL)
+		return;
+
+	g_key_file_free (journal->keyfile);
+	g_free (journal->filename);
+	g_free (journal->digest);
+	g_free (journal);
+}
+
+gchar *
+provision_journal_dup_user (ProvisionJournal *journal)
+{
+	return g_key_file_get_string (journal->keyfile, GROUP_PROVISIONING, "User", NULL);
+}
+
+/* The steps are kept: the caller forgets the ones that belonged to the
+ * previous user's account, but not those that outlive it */
+void
+provision_journal_set_user (ProvisionJournal *journal,
+                            const gchar      *user)
+{
+	gchar *current;
+
+	current = g_key_file_get_string (journal->keyfile, GROUP_PROVISIONING, "User", NULL);
+
+	if (g_strcmp0 (current, user) != 0) {
+		g_key_file_set_string (journal->keyfile, GROUP_PROVISIONING, "User", user);
+		provision_journal_save (journal);
+	}
+
+	g_free (current);
+}
+
+static gchar *
+get_salt (ProvisionJournal *journal)
+{
+	guint i;
+	gchar *salt;
+	GString *string;
+
+	salt = g_key_file_get_string (journal->keyfile, GROUP_PROVISIONING, "Salt", NULL);
+	if (salt)
+		return salt;
+
+	string = g_string_sized_new (SALT_LENGTH * 2);
+	for (i = 0; i < SALT_LENGTH; i++)
+		g_string_append_printf (string, "%02x", g_random_int_range (0, 256));
+
+	g_key_file_set_string (journal->keyfile, GROUP_PROVISIONING, "Salt", string->str);
+	provision_journal_save (journal);
+
+	return g_string_free (string, FALSE);
+}
+
+/* Steps finished from now on are recorded as done with @password */
+void
+provision_journal_set_password (ProvisionJournal *journal,
+                                const gchar      *password)
+{
+	gchar *salt;
+
+	g_clear_pointer (&journal->digest, g_free);
+
+	if (password == NULL)
+		return;
+
+	salt = get_salt (journal);
+	journal->digest = g_compute_hmac_for_string (G_CHECKSUM_SHA256,
+                                                 (const guchar *) salt, strlen (salt),
+                                                 password, -1);
+	g_free (salt);
+}
+
+/* TRUE if @step was last finished with the password given to
+ * provision_journal_set_password() */
+gboolean
+provision_journal_password_matches (ProvisionJournal *journal,
+                                    const gchar      *step)
+{
+	gchar *digest;
+	gboolean matches;
+
+	digest = g_key_file_get_string (journal->keyfile, GROUP_PASSWORDS, step, NULL);
+	matches = (digest != NULL && g_strcmp0 (digest, journal->digest) == 0);
+	g_free (digest);
+
+	return matches;
+}
+
+/* TRUE if @step was last finished with another password. A step done
+ * by a build that did not record the password counts as unchanged. */
+gboolean
+provision_journal_password_changed (ProvisionJournal *journal,
+                                    const gchar      *step)
+{
+	gchar *digest;
+	gboolean changed;
+
+	digest = g_key_file_get_string (journal->keyfile, GROUP_PASSWORDS, step, NULL);
+	changed = (digest != NULL && g_strcmp0 (digest, journal->digest) != 0);
+	g_free (digest);
+
+	return changed;
+}
+
+ProvisionStepState
+provision_journal_get_state (ProvisionJournal *journal,
+                             const gchar      *step)
+{
+	guint i;
+	gchar *value;
+	ProvisionStepState state = PROVISION_STEP_NONE;
+
+	value = g_key_file_get_string (journal->keyfile, GROUP_STEPS, step, NULL);
+	if (value == NULL)
+		return PROVISION_STEP_NONE;
+
+	for (i = 0; i < G_N_ELEMENTS (state_names); i++) {
+		if (g_str_equal (value, state_names[i]))
+			state = i;
+	}
+
+	g_free (value);
+
+	return state;
+}
+
+void
+provision_journal_set_state (ProvisionJournal   *journal,
+                             const gchar        *step,
+                             ProvisionStepState  state)
+{
+	g_return_if_fail (state < G_N_ELEMENTS (state_names));
+
+	if (provision_journal_get_state (journal, step) == state)
+		return;
+
+	if (state == PROVISION_STEP_NONE)
+		g_key_file_remove_key (journal->keyfile, GROUP_STEPS, step, NULL);
+	else
+		g_key_file_set_string (journal->keyfile, GROUP_STEPS, step, state_names[state]);
+
+	if (state == PROVISION_STEP_DONE && journal->digest)
+		g_key_file_set_string (journal->keyfile, GROUP_PASSWORDS, step, journal->digest);
+	else if (state == PROVISION_STEP_DONE || state == PROVISION_STEP_NONE)
+		g_key_file_remove_key (journal->keyfile, GROUP_PASSWORDS, step, NULL);
+
+	provision_journal_save (journal);
+}
+
+/* Listener for the provisioning graph */
+void
+provision_journal_event (const ProvisionEvent *event,
+                         gpointer              user_data)
+{
+	ProvisionJournal *journal = user_data;
+
+	switch (event->type) {
+		case PROVISION_EVENT_STARTED:
+			provision_journal_set_state (journal, event->task, PROVISION_STEP_STARTED);
+		break;
+
+		case PROVISION_EVENT_DONE:
+			provision_journal_set_state (journal, event->task, PROVISION_STEP_DONE);
+		break;
+
+		case PROVISION_EVENT_FAILED:
+			provision_journal_set_state (journal, event->task, PROVISION_STEP_FAILED);
+		break;
+
+		default:
+		break;
+	}
+}
+
+/* Forgets everything, once provisioning has finished or was undone */
+void
+provision_journal_clear (ProvisionJournal *journal)
+{
+	g_key_file_free (journal->keyfile);
+	journal->keyfile = g_key_file_new ();
+	g_clear_pointer (&journal->digest, g_free);
+
+	if (g_unlink (journal->filename) != 0 && errno != ENOENT)
+		g_warning ("Failed to remove %s: %s", journal->filename, g_strerror (errno));
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015-2020 Gooroom <gooroom@gooroom.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef __PROVISION_JOURNAL_H__
+#define __PROVISION_JOURNAL_H__
+
+#include <glib.h>
+
+#include "provision-graph.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ProvisionJournal ProvisionJournal;
+
+typedef enum {
+	PROVISION_STEP_NONE,        /* never started, or rolled back */
+	PROVISION_STEP_STARTED,     /* started, may have left partial work */
+	PROVISION_STEP_FAILED,
+	PROVISION_STEP_DONE,
+} ProvisionStepState;
+
+
+ProvisionJournal   *provision_journal_load       (const gchar          *filename);
+void                provision_journal_free       (ProvisionJournal     *journal);
+
+gchar              *provision_journal_dup_user   (ProvisionJournal     *journal);
+void                provision_journal_set_user   (ProvisionJournal     *journal,
+                                                  const gchar          *user);
+
+void                provision_journal_set_password     (ProvisionJournal *journal,
+                                                        const gchar      *password);
+gboolean            provision_journal_password_matches (ProvisionJournal *journal,
+                                                        const gchar      *step);
+gboolean            provision_journal_password_changed (ProvisionJournal *journal,
+                                                        const gchar      *step);
+
+ProvisionStepState  provision_journal_get_state  (ProvisionJournal     *journal,
+                                                  const gchar          *step);
+void                provision_journal_set_state  (ProvisionJournal     *journal,
+                                                  const gchar          *step,
+                                                  ProvisionStepState    state);
+
+void                provision_journal_event      (const ProvisionEvent *event,
+                                                  gpointer              user_data);
+
+void                provision_journal_clear      (ProvisionJournal     *journal);
+
+G_END_DECLS
+
+#endif /* __PROVISION_JOURNAL_H__ */
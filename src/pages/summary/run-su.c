@@ -21,8 +21,9 @@
  * You should have received a copy of the GNU General Public License
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  *
- * Most of this code originally comes from gnome-about-me-password.c,
- * from gnome-control-center.
+ * This used to drive /bin/su through a pipe; the PAM conversation now
+ * happens in gis-pam-session-helper, run through pkexec like the rest
+ * of provisioning.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -31,54 +32,28 @@
 
 #include <glib/gi18n.h>
 
-#include <unistd.h>
-#include <errno.h>
 #include <string.h>
-#include <sys/wait.h>
-
-#if __sun
-#include <sys/types.h>
-#include <signal.h>
-#endif
+#include <stdlib.h>
 
 #include "run-su.h"
 
-/* su states */
-typedef enum {
-	SU_STATE_NONE,              /* su is not asking for anything */
-	SU_STATE_AUTH,              /* su is asking for our current password */
-	SU_STATE_DONE,              /* su succeeded but has not yet exited */
-} SuState;
-
-struct SuHandler {
-	const char *current_password;
-	const char *user;
-
-	/* Communication with the su program */
-	GPid backend_pid;
-
-	GIOChannel *backend_stdin;
-	GIOChannel *backend_stdout;
-
-	GQueue *backend_stdin_queue;            /* Write queue to backend_stdin */
-
-	/* GMainLoop IDs */
-	guint backend_child_watch_id;           /* g_child_watch_add (PID) */
-	guint backend_stdout_watch_id;          /* g_io_add_watch (stdout) */
-
-	/* State of the passwd program */
-	SuState backend_state;
+typedef struct {
+	gint64 start_time;
+	SuResult result;
+	gchar *message;
+} SuData;
 
-	SuCallback auth_cb;
-	gpointer   auth_cb_data;
-};
-
-/* Buffer size for backend output */
-#define BUFSIZE 64
+static void
+su_data_free (gpointer data)
+{
+	SuData *d = data;
 
+	g_free (d->message);
+	g_free (d);
+}
 
-static GQuark
-passwd_error_quark (void)
+GQuark
+su_error_quark (void)
 {
 	static GQuark q = 0;
 
@@ -89,418 +64,164 @@ passwd_error_quark (void)
 	return q;
 }
 
-/* Error handling */
-#define SU_ERROR (passwd_error_quark ())
-
-
-static void stop_su (SuHandler *su_handler);
-static void free_su_resources (SuHandler *su_handler);
-static gboolean io_watch_stdout (GIOChannel *source, GIOCondition condition, SuHandler *su_handler);
-
-
-/*
- * Spawning and closing of backend {{
- */
-
-/* Child watcher */
-static void
-child_watch_cb (GPid pid, gint status, SuHandler *su_handler)
-{
-	if (WIFEXITED (status)) {
-		if (WEXITSTATUS (status) >= 255) {
-			g_warning ("Child exited unexpectedly");
-		}
-		if (WEXITSTATUS (status) == 0) {
-			if (su_handler->backend_state == SU_STATE_AUTH) {
-				su_handler->backend_state = SU_STATE_DONE;
-				if (su_handler->auth_cb) {
-					su_handler->auth_cb (su_handler, NULL, su_handler->auth_cb_data);
-				}
-			}
-		}
-	}
-
-	free_su_resources (su_handler);
-}
-
-static void
-ignore_sigpipe (gpointer data)
-{
-	signal (SIGPIPE, SIG_IGN);
-}
-
-/* Spawn passwd backend
- * Returns: TRUE on success, FALSE otherwise and sets error appropriately */
-static gboolean
-spawn_su (SuHandler *su_handler, GError **error)
-{
-	gchar   *argv[3] = {0,};
-	gchar  **envp;
-	gint    my_stdin, my_stdout, my_stderr;
-
-	argv[0] = "/bin/su";
-	argv[1] = g_strdup (su_handler->user);
-	argv[2] = NULL;
-
-	envp = g_get_environ ();
-	envp = g_environ_setenv (envp, "LC_ALL", "C", TRUE);
-
-	if (!g_spawn_async_with_pipes (NULL,                            /* Working directory */
-                                   argv,                            /* Argument vector */
-                                   envp,                            /* Environment */
-                                   G_SPAWN_DO_NOT_REAP_CHILD,       /* Flags */
-                                   ignore_sigpipe,                  /* Child setup */
-                                   NULL,                            /* Data to child setup */
-                                   &su_handler->backend_pid,    /* PID */
-                                   &my_stdin,                       /* Stdin */
-                                   &my_stdout,                      /* Stdout */
-                                   &my_stderr,                      /* Stderr */
-                                   error)) {                        /* GError */
-
-		/* An error occured */
-		free_su_resources (su_handler);
-
-		g_strfreev (envp);
-
-		return FALSE;
-	}
-
-	g_free (argv[1]);
-	g_strfreev (envp);
-
-	/* 2>&1 */
-	if (dup2 (my_stderr, my_stdout) == -1) {
-		/* Failed! */
-		g_set_error_literal (error,
-				SU_ERROR,
-				SU_ERROR_BACKEND,
-				strerror (errno));
-
-		/* Clean up */
-		stop_su (su_handler);
-
-		return FALSE;
-	}
-
-	/* Open IO Channels */
-	su_handler->backend_stdin = g_io_channel_unix_new (my_stdin);
-	su_handler->backend_stdout = g_io_channel_unix_new (my_stdout);
-
-	/* Set raw encoding */
-	/* Set nonblocking mode */
-	if (g_io_channel_set_encoding (su_handler->backend_stdin, NULL, error) != G_IO_STATUS_NORMAL ||
-        g_io_channel_set_encoding (su_handler->backend_stdout, NULL, error) != G_IO_STATUS_NORMAL ||
-        g_io_channel_set_flags (su_handler->backend_stdin, G_IO_FLAG_NONBLOCK, error) != G_IO_STATUS_NORMAL ||
-        g_io_channel_set_flags (su_handler->backend_stdout, G_IO_FLAG_NONBLOCK, error) != G_IO_STATUS_NORMAL ) {
-
-		/* Clean up */
-		stop_su (su_handler);
-		return FALSE;
-	}
-
-	/* Turn off buffering */
-	g_io_channel_set_buffered (su_handler->backend_stdin, FALSE);
-	g_io_channel_set_buffered (su_handler->backend_stdout, FALSE);
-
-	/* Add IO Channel watcher */
-	su_handler->backend_stdout_watch_id = g_io_add_watch (su_handler->backend_stdout,
-                                                          G_IO_IN | G_IO_PRI,
-                                                          (GIOFunc) io_watch_stdout, su_handler);
-
-	/* Add child watcher */
-	su_handler->backend_child_watch_id = g_child_watch_add (su_handler->backend_pid,
-                                                            (GChildWatchFunc) child_watch_cb,
-                                                            su_handler);
-
-	/* Success! */
-	return TRUE;
-}
-
-/* Stop passwd backend */
-static void
-stop_su (SuHandler *su_handler)
+static SuStage
+parse_stage (const gchar *value)
 {
-	/* This is the standard way of returning from the dialog with passwd.
-	 * If we return this way we can safely kill passwd as it has completed
-	 * its task.
-	 */
-	if (su_handler->backend_pid != -1) {
-		kill (su_handler->backend_pid, 9);
-	}
-
-	/* We must run free_su_resources here and not let our child
-	 * watcher do it, since it will access invalid memory after the
-	 * dialog has been closed and cleaned up.
-	 *
-	 * If we had more than a single thread we'd need to remove
-	 * the child watch before trying to kill the child.
-	 */
-	free_su_resources (su_handler);
+	if (g_str_equal (value, "authenticate"))
+		return SU_STAGE_AUTHENTICATE;
+	if (g_str_equal (value, "open-session"))
+		return SU_STAGE_OPEN_SESSION;
+	if (g_str_equal (value, "close-session"))
+		return SU_STAGE_CLOSE_SESSION;
+	if (g_str_equal (value, "done"))
+		return SU_STAGE_DONE;
+
+	return SU_STAGE_NONE;
 }
 
-/* Clean up passwd resources */
+/* Reads the key=value lines written by the helper */
 static void
-free_su_resources (SuHandler *su_handler)
+parse_helper_output (SuData      *data,
+                     const gchar *output)
 {
-	GError  *error = NULL;
-
-	/* Remove the child watcher */
-	if (su_handler->backend_child_watch_id != 0) {
-		g_source_remove (su_handler->backend_child_watch_id);
-		su_handler->backend_child_watch_id = 0;
-	}
-
-
-	/* Close IO channels (internal file descriptors are automatically closed) */
-	if (su_handler->backend_stdin != NULL) {
-		if (g_io_channel_shutdown (su_handler->backend_stdin, TRUE, &error) != G_IO_STATUS_NORMAL) {
-			g_warning ("Could not shutdown backend_stdin IO channel: %s", error->message);
-			g_error_free (error);
-			error = NULL;
-		}
-		g_io_channel_unref (su_handler->backend_stdin);
-		su_handler->backend_stdin = NULL;
-	}
-
-	if (su_handler->backend_stdout != NULL) {
-		if (g_io_channel_shutdown (su_handler->backend_stdout, TRUE, &error) != G_IO_STATUS_NORMAL) {
-			g_warning ("Could not shutdown backend_stdout IO channel: %s", error->message);
-			g_error_free (error);
-			error = NULL;
+	guint i;
+	gchar **lines;
+
+	lines = g_strsplit (output, "\n", -1);
+
+	for (i = 0; lines[i] != NULL; i++) {
+		gchar *value = strchr (lines[i], '=');
+
+		if (value == NULL)
+			continue;
+
+		*value++ = '\0';
+
+		if (g_str_equal (lines[i], "stage")) {
+			data->result.stage = parse_stage (value);
+		} else if (g_str_equal (lines[i], "status")) {
+			data->result.pam_status = atoi (value);
+		} else if (g_str_equal (lines[i], "message")) {
+			g_free (data->message);
+			data->message = g_strdup (value);
+		} else if (g_str_equal (lines[i], "authenticate-usec")) {
+			data->result.authenticate_time = g_ascii_strtoll (value, NULL, 10);
+		} else if (g_str_equal (lines[i], "open-session-usec")) {
+			data->result.open_session_time = g_ascii_strtoll (value, NULL, 10);
+		} else if (g_str_equal (lines[i], "close-session-usec")) {
+			data->result.close_session_time = g_ascii_strtoll (value, NULL, 10);
 		}
-		g_io_channel_unref (su_handler->backend_stdout);
-		su_handler->backend_stdout = NULL;
-	}
-
-	/* Remove IO watcher */
-	if (su_handler->backend_stdout_watch_id != 0) {
-		g_source_remove (su_handler->backend_stdout_watch_id);
-		su_handler->backend_stdout_watch_id = 0;
 	}
 
-	/* Close PID */
-	if (su_handler->backend_pid != -1) {
-		g_spawn_close_pid (su_handler->backend_pid);
-		su_handler->backend_pid = -1;
-	}
-
-	/* Clear backend state */
-	su_handler->backend_state = SU_STATE_NONE;
+	g_strfreev (lines);
 }
 
-/*
- * }} Spawning and closing of backend
- */
-
-/*
- * Backend communication code {{
- */
-
-/* Write the first element of queue through channel */
 static void
-io_queue_pop (GQueue *queue, GIOChannel *channel)
-{
-	gchar   *buf;
-	gsize   bytes_written;
-	GError  *error = NULL;
-
-	buf = g_queue_pop_head (queue);
-
-	if (buf != NULL) {
-
-		if (g_io_channel_write_chars (channel, buf, -1, &bytes_written, &error) != G_IO_STATUS_NORMAL) {
-			g_warning ("Could not write queue element \"%s\" to channel: %s", buf, error->message);
-			g_error_free (error);
-		}
-
-		/* Ensure passwords are cleared from memory */
-		memset (buf, 0, strlen (buf));
-		g_free (buf);
-	}
-}
-
-/* Goes through the argument list, checking if one of them occurs in str
- * Returns: TRUE as soon as an element is found to match, FALSE otherwise */
-static gboolean
-is_string_complete (gchar *str, ...)
-{
-	va_list ap;
-	gchar   *arg;
-
-	if (strlen (str) == 0) {
-		return FALSE;
-	}
-
-	va_start (ap, str);
-
-	while ((arg = va_arg (ap, char *)) != NULL) {
-		if (strstr (str, arg) != NULL) {
-			va_end (ap);
-			return TRUE;
-		}
-	}
-
-	va_end (ap);
-
-	return FALSE;
-}
-
-/*
- * IO watcher for stdout, called whenever there is data to read from the backend.
- * This is where most of the actual IO handling happens.
- */
-static gboolean
-io_watch_stdout (GIOChannel *source, GIOCondition condition, SuHandler *su_handler)
+helper_done_cb (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
 {
-	static GString *str = NULL;     /* Persistent buffer */
-
-	gchar           buf[BUFSIZE];           /* Temporary buffer */
-	gsize           bytes_read;
-	GError          *gio_error = NULL;      /* Error returned by functions */
-	GError          *error = NULL;          /* Error sent to callbacks */
-
-	gboolean        reinit = FALSE;
+	gchar *output = NULL;
+	GError *error = NULL;
+	GTask *task = G_TASK (user_data);
+	SuData *data = g_task_get_task_data (task);
 
-	/* Initialize buffer */
-	if (str == NULL) {
-		str = g_string_new ("");
+	if (!g_subprocess_communicate_utf8_finish (G_SUBPROCESS (source_object), res, &output, NULL, &error)) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
 	}
 
-	if (g_io_channel_read_chars (source, buf, BUFSIZE, &bytes_read, &gio_error) != G_IO_STATUS_NORMAL) {
-		g_warning ("IO Channel read error: %s", gio_error->message);
-		g_error_free (gio_error);
+	data->result.total_time = g_get_monotonic_time () - data->start_time;
 
-		return TRUE;
-	}
+	if (output)
+		parse_helper_output (data, output);
+	g_free (output);
 
-	str = g_string_append_len (str, buf, bytes_read);
-
-	/* In which state is the backend? */
-	switch (su_handler->backend_state) {
-		case SU_STATE_AUTH:
-			if (strstr (str->str, "Authentication failure") != NULL) {
-				/* Authentication failed */
-				error = g_error_new_literal (SU_ERROR, SU_ERROR_AUTH_FAILED,
-                                             _("Authentication failed"));
-
-				if (su_handler->auth_cb)
-					su_handler->auth_cb (su_handler, error, su_handler->auth_cb_data);
-
-				g_error_free (error);
-			} else {
-				/* Authentication successful */
-				if (su_handler->auth_cb)
-					su_handler->auth_cb (su_handler, NULL, su_handler->auth_cb_data);
-			}
-			reinit = TRUE;
+	switch (data->result.stage) {
+		case SU_STAGE_DONE:
+			g_task_return_boolean (task, TRUE);
 		break;
 
-		case SU_STATE_NONE:
-			/* su is not asking for anything yet */
-			if (is_string_complete (str->str, "assword: ", NULL)) {
-				su_handler->backend_state = SU_STATE_AUTH;
-
-				/* Pop the IO queue, i.e. send current password */
-				io_queue_pop (su_handler->backend_stdin_queue, su_handler->backend_stdin);
+		case SU_STAGE_AUTHENTICATE:
+			g_task_return_new_error (task, SU_ERROR, SU_ERROR_AUTH_FAILED,
+                                     _("Authentication failed: %s"),
+                                     data->message ? data->message : "");
+		break;
 
-				reinit = TRUE;
-			}
+		case SU_STAGE_OPEN_SESSION:
+		case SU_STAGE_CLOSE_SESSION:
+			g_task_return_new_error (task, SU_ERROR, SU_ERROR_SESSION,
+                                     "Failed to %s the session: %s",
+                                     data->result.stage == SU_STAGE_OPEN_SESSION ? "open" : "close",
+                                     data->message ? data->message : "");
 		break;
 
 		default:
-			/* su has returned an error */
-			reinit = TRUE;
+			g_task_return_new_error (task, SU_ERROR, SU_ERROR_BACKEND,
+                                     "%s exited with status %d",
+                                     GIS_PAM_SESSION_HELPER,
+                                     g_subprocess_get_exit_status (G_SUBPROCESS (source_object)));
 		break;
 	}
 
-	if (reinit) {
-		g_string_free (str, TRUE);
-		str = NULL;
-	}
-
-	/* Continue calling us */
-	return TRUE;
-}
-
-/*
- * }} Backend communication code
- */
-
-/* Adds the current password to the IO queue */
-static void
-authenticate (SuHandler *su_handler)
-{
-	gchar *s;
-
-	s = g_strdup_printf ("%s\n", su_handler->current_password);
-
-	g_queue_push_tail (su_handler->backend_stdin_queue, s);
+	g_object_unref (task);
 }
 
-SuHandler *
-su_init (void)
+void
+su_open_session_async (const char          *user,
+                       const char          *password,
+                       GCancellable        *cancellable,
+                       GAsyncReadyCallback  callback,
+                       gpointer             user_data)
 {
-	SuHandler *su_handler;
-
-	su_handler = g_new0 (SuHandler, 1);
-
-	/* Initialize backend_pid. -1 means the backend is not running */
-	su_handler->backend_pid = -1;
-
-	/* Initialize IO Channels */
-	su_handler->backend_stdin = NULL;
-	su_handler->backend_stdout = NULL;
+	gchar *input;
+	GTask *task;
+	SuData *data;
+	GError *error = NULL;
+	GSubprocess *subprocess;
 
-	/* Initialize write queue */
-	su_handler->backend_stdin_queue = g_queue_new ();
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, su_open_session_async);
 
-	/* Initialize watchers */
-	su_handler->backend_child_watch_id = 0;
-	su_handler->backend_stdout_watch_id = 0;
+	data = g_new0 (SuData, 1);
+	data->start_time = g_get_monotonic_time ();
+	g_task_set_task_data (task, data, su_data_free);
 
-	/* Initialize backend state */
-	su_handler->backend_state = SU_STATE_NONE;
+	subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE,
+                                   &error,
+                                   "/usr/bin/pkexec", GIS_PAM_SESSION_HELPER, "-u", user, NULL);
+	if (subprocess == NULL) {
+		g_task_return_new_error (task, SU_ERROR, SU_ERROR_BACKEND,
+                                 "%s", error->message);
+		g_error_free (error);
+		g_object_unref (task);
+		return;
+	}
 
-	return su_handler;
-}
+	/* communicate_utf8 copies the input before returning */
+	input = g_strdup_printf ("%s\n", password);
+	g_subprocess_communicate_utf8_async (subprocess, input, cancellable, helper_done_cb, task);
+	memset (input, 0, strlen (input));
+	g_free (input);
 
-void
-su_destroy (SuHandler *su_handler)
-{
-	g_queue_free (su_handler->backend_stdin_queue);
-	stop_su (su_handler);
-	g_free (su_handler);
+	g_object_unref (subprocess);
 }
 
-void
-su_authenticate (SuHandler     *su_handler,
-                 const char    *user,
-                 const char    *current_password,
-                 SuCallback     cb,
-                 const gpointer user_data)
+/* @result is filled in whenever the helper got far enough to report,
+ * also when an error is returned. */
+gboolean
+su_open_session_finish (GAsyncResult  *res,
+                        SuResult      *result,
+                        GError       **error)
 {
-	GError *error = NULL;
-
-	/* Clear data from possible previous attempts to change password */
-	su_handler->user = user;
-	su_handler->current_password = current_password;
-	su_handler->auth_cb = cb;
-	su_handler->auth_cb_data = user_data;
-
-	g_queue_foreach (su_handler->backend_stdin_queue, (GFunc) g_free, NULL);
-	g_queue_clear (su_handler->backend_stdin_queue);
-
-	/* Spawn backend */
-	stop_su (su_handler);
+	SuData *data;
 
-	if (!spawn_su (su_handler, &error)) {
-		g_warning ("%s", error->message);
-		g_error_free (error);
-
-		return;
-	}
+	g_return_val_if_fail (g_task_is_valid (res, NULL), FALSE);
 
-	authenticate (su_handler);
+	data = g_task_get_task_data (G_TASK (res));
+	if (result)
+		*result = data->result;
 
-	/* Our IO watcher should now handle the rest */
+	return g_task_propagate_boolean (G_TASK (res), error);
 }
@@ -21,31 +21,50 @@
 #ifndef __RUN_SU_H__
 #define __RUN_SU_H__
 
+#include <gio/gio.h>
 
-struct SuHandler;
-
-typedef struct SuHandler SuHandler;
-
-typedef void (*SuCallback) (SuHandler *su_handler, GError *error, const gpointer user_data);
+G_BEGIN_DECLS
 
 /* Error codes */
 typedef enum {
-	SU_ERROR_AUTH_FAILED,       /* Wrong old password, or PAM failure */
+	SU_ERROR_AUTH_FAILED,       /* Wrong password, or PAM failure */
+	SU_ERROR_SESSION,           /* The session could not be opened or closed */
 	SU_ERROR_BACKEND,           /* Backend error */
 } SuError;
 
+#define SU_ERROR (su_error_quark ())
+
+typedef enum {
+	SU_STAGE_NONE,              /* the helper did not report anything */
+	SU_STAGE_AUTHENTICATE,
+	SU_STAGE_OPEN_SESSION,
+	SU_STAGE_CLOSE_SESSION,
+	SU_STAGE_DONE,
+} SuStage;
 
-SuHandler *su_init            (void);
+/* Times are in microseconds */
+typedef struct {
+	SuStage stage;              /* last stage reached */
+	gint    pam_status;         /* PAM return code of that stage */
+	gint64  authenticate_time;
+	gint64  open_session_time;
+	gint64  close_session_time;
+	gint64  total_time;         /* including the pkexec round trip */
+} SuResult;
 
-void       su_destroy         (SuHandler  *su_handler);
 
-void       su_authenticate    (SuHandler  *su_handler,
-                               const char *user,
-                               const char *current_password,
-                               SuCallback  cb,
-                               gpointer    user_data);
+GQuark     su_error_quark          (void);
+
+void       su_open_session_async   (const char          *user,
+                                    const char          *password,
+                                    GCancellable        *cancellable,
+                                    GAsyncReadyCallback  callback,
+                                    gpointer             user_data);
+
+gboolean   su_open_session_finish  (GAsyncResult        *res,
+                                    SuResult            *result,
+                                    GError             **error);
 
 G_END_DECLS
 
 #endif /* __RUN_SU_H__ */
-
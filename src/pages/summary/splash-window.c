@@ -31,8 +31,18 @@ struct _SplashWindowPrivate
 {
 	GtkWidget *message_label;
 	GtkWidget *spinner;
+	GtkWidget *progress_bar;
+	GtkWidget *steps_grid;
+
+	/* step name -> SplashStep, rows in the order they were added */
+	GHashTable *steps;
 };
 
+typedef struct {
+	GtkWidget *status_label;
+	gdouble    fraction;
+} SplashStep;
+
 
 
 G_DEFINE_TYPE_WITH_PRIVATE (SplashWindow, splash_window, GTK_TYPE_WINDOW);
@@ -41,6 +51,10 @@ G_DEFINE_TYPE_WITH_PRIVATE (SplashWindow, splash_window, GTK_TYPE_WINDOW);
 static void
 splash_window_finalize (GObject *object)
 {
+	SplashWindow *window = SPLASH_WINDOW (object);
+
+	g_hash_table_destroy (window->priv->steps);
+
 	G_OBJECT_CLASS (splash_window_parent_class)->finalize (object);
 }
 
@@ -51,6 +65,8 @@ splash_window_init (SplashWindow *window)
 
 	gtk_widget_init_template (GTK_WIDGET (window));
 
+	window->priv->steps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
 	gtk_window_set_decorated (GTK_WINDOW (window), FALSE);
 	gtk_window_set_skip_taskbar_hint (GTK_WINDOW (window), TRUE);
 	gtk_window_set_skip_pager_hint (GTK_WINDOW (window), TRUE);
@@ -80,6 +96,10 @@ splash_window_class_init (SplashWindowClass *klass)
                                                   SplashWindow, message_label);
 	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
                                                   SplashWindow, spinner);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                  SplashWindow, progress_bar);
+	gtk_widget_class_bind_template_child_private (GTK_WIDGET_CLASS (klass),
+                                                  SplashWindow, steps_grid);
 }
 
 SplashWindow *
@@ -126,3 +146,108 @@ splash_window_set_message_label (SplashWindow *window,
 		gtk_label_set_text (GTK_LABEL (priv->message_label), "");
 	}
 }
+
+/* Adds a row for the provisioning step @name; events of steps that
+ * were not added are ignored. */
+void
+splash_window_add_step (SplashWindow *window,
+                        const char   *name,
+                        const char   *title)
+{
+	gint row;
+	GtkWidget *label;
+	SplashStep *step;
+	SplashWindowPrivate *priv;
+
+	g_return_if_fail (SPLASH_IS_WINDOW (window));
+
+	priv = window->priv;
+
+	if (g_hash_table_contains (priv->steps, name))
+		return;
+
+	row = g_hash_table_size (priv->steps);
+
+	label = gtk_label_new (title);
+	gtk_label_set_xalign (GTK_LABEL (label), 0);
+	gtk_widget_set_hexpand (label, TRUE);
+	gtk_grid_attach (GTK_GRID (priv->steps_grid), label, 0, row, 1, 1);
+	gtk_widget_show (label);
+
+	step = g_new0 (SplashStep, 1);
+	step->status_label = gtk_label_new (_("Waiting"));
+	gtk_label_set_xalign (GTK_LABEL (step->status_label), 1);
+	gtk_style_context_add_class (gtk_widget_get_style_context (step->status_label), "dim-label");
+	gtk_grid_attach (GTK_GRID (priv->steps_grid), step->status_label, 1, row, 1, 1);
+	gtk_widget_show (step->status_label);
+
+	g_hash_table_insert (priv->steps, g_strdup (name), step);
+}
+
+static void
+update_progress_bar (SplashWindow *window)
+{
+	guint n_steps;
+	gdouble total = 0.0;
+	GHashTableIter iter;
+	SplashStep *step;
+	SplashWindowPrivate *priv = window->priv;
+
+	n_steps = g_hash_table_size (priv->steps);
+	if (n_steps == 0)
+		return;
+
+	g_hash_table_iter_init (&iter, priv->steps);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &step))
+		total += step->fraction;
+
+	gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (priv->progress_bar), total / n_steps);
+}
+
+void
+splash_window_push_event (SplashWindow         *window,
+                          const ProvisionEvent *event)
+{
+	gchar *status = NULL;
+	SplashStep *step;
+
+	g_return_if_fail (SPLASH_IS_WINDOW (window));
+
+	step = g_hash_table_lookup (window->priv->steps, event->task);
+	if (step == NULL)
+		return;
+
+	step->fraction = event->fraction;
+
+	switch (event->type) {
+		case PROVISION_EVENT_STARTED:
+			status = g_strdup (_("In progress"));
+		break;
+
+		case PROVISION_EVENT_PROGRESS:
+			status = g_strdup_printf (_("In progress (%d%%)"), (gint) (event->fraction * 100));
+		break;
+
+		case PROVISION_EVENT_DONE:
+			status = g_strdup_printf (_("Done (%.1f s)"), event->elapsed / (gdouble) G_USEC_PER_SEC);
+		break;
+
+		case PROVISION_EVENT_FAILED:
+			status = g_strdup (_("Failed"));
+		break;
+
+		case PROVISION_EVENT_SKIPPED:
+			status = g_strdup (_("Already done"));
+		break;
+
+		default:
+		break;
+	}
+
+	if (status)
+		gtk_label_set_text (GTK_LABEL (step->status_label), status);
+
+	update_progress_bar (window);
+
+	g_free (status);
+}
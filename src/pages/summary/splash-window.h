@@ -23,6 +23,8 @@
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
 
+#include "provision-graph.h"
+
 G_BEGIN_DECLS
 
 #define SPLASH_TYPE_WINDOW         (splash_window_get_type ())
@@ -55,6 +57,12 @@ void           splash_window_destroy           (SplashWindow *window);
 void           splash_window_set_message_label (SplashWindow *window,
                                                 const char   *message);
 
+void           splash_window_add_step          (SplashWindow *window,
+                                                const char   *name,
+                                                const char   *title);
+void           splash_window_push_event        (SplashWindow         *window,
+                                                const ProvisionEvent *event);
+
 G_END_DECLS
 
 #endif /* __SPLASH_WINDOW_H__ */